@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#define BENCHMARK_DUP _dup
+#define BENCHMARK_DUP2 _dup2
+#define BENCHMARK_NULL "NUL"
+#else
+#include <unistd.h>
+#define BENCHMARK_DUP dup
+#define BENCHMARK_DUP2 dup2
+#define BENCHMARK_NULL "/dev/null"
+#endif
+
+
+
+/**
+ * Small microbenchmark harness for the CPU side of the program.
+ *
+ * Every case is first run for a while without measuring (warmup, fills caches and lets the CPU clock up), then the
+ * number of iterations per sample is found so that a sample takes at least Settings::sampleSeconds, and finally a
+ * number of samples are timed. The time per iteration of each sample is what the statistics are computed from, so a
+ * single interrupted sample shows up as an outlier (max, stddev) instead of skewing everything. Use the median when
+ * comparing before and after a change.
+ *
+ *      BENCHMARK::Suite suite(settings);
+ *      suite.add("image/flipY", [&]() { image.flipY(); });
+ *      return suite.run();
+ */
+namespace BENCHMARK
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Settings
+    {
+        double warmupSeconds = 0.2;  // time each case runs before measuring
+        double sampleSeconds = 0.02; // shortest time of a sample, short cases are repeated within it
+        int samples          = 30;   // number of timed samples per case
+        std::string filter;          // only run the cases whose name contains this
+        std::string jsonFile = "benchmarks.json";
+    };
+
+    // Statistics of one case, times are nanoseconds per iteration
+    struct Result
+    {
+        std::string name;
+        unsigned long iterations = 0; // per sample
+        int samples              = 0;
+        double mean              = 0;
+        double median            = 0;
+        double stddev            = 0;
+        double min               = 0;
+        double max               = 0;
+        double confidence        = 0; // half width of the 95% confidence interval of the mean
+    };
+
+    /** Keeps the compiler from optimizing away a result that is otherwise unused */
+    template <class T>
+    inline void doNotOptimize(T const &value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void *sink;
+        sink = &value;
+#endif
+    }
+
+    /** Sends stdout to the null device while it exists, so verbose loading messages do not cost time or flood the output */
+    class QuietStdout
+    {
+    public:
+        QuietStdout()
+        {
+            fflush(stdout);
+            saved = BENCHMARK_DUP(fileno(stdout));
+            if (!freopen(BENCHMARK_NULL, "w", stdout)) saved = -1;
+        }
+
+        ~QuietStdout()
+        {
+            fflush(stdout);
+            if (saved != -1) BENCHMARK_DUP2(saved, fileno(stdout));
+        }
+
+    private:
+        int saved;
+    };
+
+
+
+    class Suite
+    {
+    public:
+        Suite(Settings settings)
+        {
+            this->settings = settings;
+        }
+
+        void add(std::string const &name, std::function<void()> function)
+        {
+            cases.push_back({ name, function });
+        }
+
+        /**
+         * @brief Runs all cases (matching the filter), prints a table to stderr and writes the JSON file
+         *
+         * @return Exit code for main
+         */
+        int run()
+        {
+            std::vector<Result> results;
+            fprintf(stderr, "%-36s %12s %12s %12s %10s %10s\n", "case", "median", "mean", "min", "+-95%", "iters");
+            for (Case &c : cases)
+            {
+                if (c.name.find(settings.filter) == std::string::npos) continue;
+                Result result;
+                {
+                    QuietStdout quiet;
+                    result = measure(c);
+                }
+                fprintf(stderr, "%-36s %12s %12s %12s %9.1f%% %10lu\n", result.name.c_str(), format(result.median).c_str(),
+                        format(result.mean).c_str(), format(result.min).c_str(), 100 * result.confidence / result.mean, result.iterations);
+                results.push_back(result);
+            }
+            if (results.empty())
+            {
+                fprintf(stderr, "No benchmarks match \"%s\"\n", settings.filter.c_str());
+                return EXIT_FAILURE;
+            }
+            if (!settings.jsonFile.empty() && !writeJSON(results)) return EXIT_FAILURE;
+            return EXIT_SUCCESS;
+        }
+
+
+
+    private:
+        struct Case
+        {
+            std::string name;
+            std::function<void()> function;
+        };
+
+        Settings settings;
+        std::vector<Case> cases;
+
+        // Nanoseconds per iteration for running the case the given number of times
+        static double time(Case &c, unsigned long iterations)
+        {
+            Clock::time_point start = Clock::now();
+            for (unsigned long i = 0; i < iterations; i++) c.function();
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+        }
+
+        Result measure(Case &c)
+        {
+            // Warmup, also gives a first estimate of how long one iteration takes
+            unsigned long warmupIterations = 0;
+            Clock::time_point start        = Clock::now();
+            while (std::chrono::duration<double>(Clock::now() - start).count() < settings.warmupSeconds || warmupIterations == 0)
+            {
+                c.function();
+                warmupIterations++;
+            }
+            double estimate = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / warmupIterations;
+
+            Result result;
+            result.name       = c.name;
+            result.samples    = std::max(settings.samples, 2);
+            result.iterations = std::max(1UL, (unsigned long)std::ceil(settings.sampleSeconds * 1e9 / estimate));
+
+            std::vector<double> samples(result.samples);
+            for (double &sample : samples) sample = time(c, result.iterations);
+
+            std::sort(samples.begin(), samples.end());
+            size_t middle = samples.size() / 2;
+            result.median = samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+            result.min    = samples.front();
+            result.max    = samples.back();
+
+            for (double sample : samples) result.mean += sample;
+            result.mean /= samples.size();
+            for (double sample : samples) result.stddev += (sample - result.mean) * (sample - result.mean);
+            result.stddev     = std::sqrt(result.stddev / (samples.size() - 1));
+            result.confidence = 1.96 * result.stddev / std::sqrt((double)samples.size());
+            return result;
+        }
+
+        static std::string format(double nanoseconds)
+        {
+            char text[32];
+            if (nanoseconds < 1e3)
+                snprintf(text, sizeof(text), "%.1f ns", nanoseconds);
+            else if (nanoseconds < 1e6)
+                snprintf(text, sizeof(text), "%.2f us", nanoseconds / 1e3);
+            else
+                snprintf(text, sizeof(text), "%.2f ms", nanoseconds / 1e6);
+            return text;
+        }
+
+        bool writeJSON(std::vector<Result> const &results)
+        {
+            FILE *file = fopen(settings.jsonFile.c_str(), "w");
+            if (!file)
+            {
+                fprintf(stderr, "Could not write %s\n", settings.jsonFile.c_str());
+                return false;
+            }
+
+            char date[32];
+            time_t now = std::time(nullptr);
+            strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+#ifdef NDEBUG
+            const char *build = "release";
+#else
+            const char *build = "debug";
+#endif
+
+            fprintf(file, "{\n  \"date\": \"%s\",\n  \"build\": \"%s\",\n", date, build);
+            fprintf(file, "  \"warmup_seconds\": %g,\n  \"sample_seconds\": %g,\n", settings.warmupSeconds, settings.sampleSeconds);
+            fprintf(file, "  \"benchmarks\": [\n");
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                const Result &r = results[i];
+                fprintf(file, "    {\"name\": \"%s\", \"iterations\": %lu, \"samples\": %d, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+                              "\"stddev_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f, \"ci95_ns\": %.3f}%s\n",
+                        r.name.c_str(), r.iterations, r.samples, r.median, r.mean, r.stddev, r.min, r.max, r.confidence,
+                        i + 1 < results.size() ? "," : "");
+            }
+            fprintf(file, "  ]\n}\n");
+            fclose(file);
+            fprintf(stderr, "Wrote %s\n", settings.jsonFile.c_str());
+            return true;
+        }
+    };
+}
+
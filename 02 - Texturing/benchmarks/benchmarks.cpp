@@ -0,0 +1,106 @@
+// System headers (before the local ones, gamelogic.h needs GLFW)
+#include <GLFW/glfw3.h>
+#include <glad/glad.h>
+
+// Local headers
+#include "benchmark.hpp"
+#include "gamelogic.h"
+#include "sceneGraph.hpp"
+#include "utilities/glfont.h"
+#include "utilities/glutils.h"
+#include "utilities/imageLoader.hpp"
+#include "utilities/shapes.h"
+
+// Standard headers
+#include <arrrgh.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdlib>
+#include <iostream>
+
+// Files used by the cases, relative to the build directory like the program itself
+const std::string textureFile = "../res/textures/charmap.png";
+
+int main(int argc, const char *argb[])
+{
+    arrrgh::parser parser("benchmarks", "Microbenchmarks of the CPU heavy parts of glowbox");
+    const auto &showHelp   = parser.add<bool>("help", "Show this help message.", 'h', arrrgh::Optional, false);
+    const auto &filter     = parser.add<std::string>("filter", "Only run cases whose name contains this.", 'f', arrrgh::Optional, "");
+    const auto &jsonFile   = parser.add<std::string>("json", "Where to write the results.", 'j', arrrgh::Optional, "benchmarks.json");
+    const auto &samples    = parser.add<int>("samples", "Number of timed samples per case.", 's', arrrgh::Optional, 30);
+    const auto &sampleTime = parser.add<int>("sample-time", "Shortest duration of a sample in milliseconds.", 't', arrrgh::Optional, 20);
+    const auto &warmupTime = parser.add<int>("warmup", "Time each case runs before it is measured in milliseconds.", 'w', arrrgh::Optional, 200);
+
+    try
+    {
+        parser.parse(argc, argb);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error parsing arguments: " << e.what() << std::endl;
+        parser.show_usage(std::cerr);
+        exit(1);
+    }
+
+    // Show help if desired
+    if (showHelp.value())
+    {
+        return 0;
+    }
+
+    BENCHMARK::Settings settings;
+    settings.filter        = filter.value();
+    settings.jsonFile      = jsonFile.value();
+    settings.samples       = samples.value();
+    settings.sampleSeconds = sampleTime.value() / 1000.0;
+    settings.warmupSeconds = warmupTime.value() / 1000.0;
+    BENCHMARK::Suite suite(settings);
+
+    // Generated geometry, the same shapes the game uses
+    suite.add("shapes/cube", []() {
+        Mesh mesh = cube(glm::vec3(180, 90, 90), glm::vec2(90), true, true);
+        BENCHMARK::doNotOptimize(mesh.vertices.data());
+    });
+    suite.add("shapes/generateSphere", []() {
+        Mesh mesh = generateSphere(1.0, 40, 40);
+        BENCHMARK::doNotOptimize(mesh.vertices.data());
+    });
+    suite.add("glfont/generateTextGeometryBuffer", []() {
+        Mesh mesh = generateTextGeometryBuffer("Hello World", 0.3f);
+        BENCHMARK::doNotOptimize(mesh.vertices.data());
+    });
+
+    Mesh sphere = generateSphere(1.0, 40, 40);
+    suite.add("glutils/computeTangentBasis", [&]() {
+        std::vector<glm::vec3> tangents, bitangents;
+        computeTangentBasis(sphere.vertices, sphere.textureCoordinates, tangents, bitangents);
+        BENCHMARK::doNotOptimize(tangents.data());
+    });
+
+    suite.add("imageLoader/loadPNGFile", []() {
+        PNGImage image = loadPNGFile(textureFile);
+        BENCHMARK::doNotOptimize(image.pixels.data());
+    });
+
+    // A scene graph of 1 + 10 + 10 * 100 nodes
+    SceneNode *root = createSceneNode();
+    for (int i = 0; i < 10; i++)
+    {
+        SceneNode *group = createSceneNode();
+        group->rotation  = { 0, 0.6f * i, 0 };
+        addChild(root, group);
+        for (int j = 0; j < 100; j++)
+        {
+            SceneNode *node = createSceneNode();
+            node->position  = { float(j), 0, 0 };
+            node->rotation  = { 0.1f * j, 0, 0 };
+            addChild(group, node);
+        }
+    }
+    glm::mat4 VP = glm::perspective(glm::radians(80.0f), 16.0f / 9.0f, 0.1f, 350.f);
+    suite.add("gamelogic/updateNodeTransformations 1011 nodes", [&]() {
+        updateNodeTransformations(root, glm::mat4(1), VP);
+        BENCHMARK::doNotOptimize(root->children.back()->children.back()->MVP);
+    });
+
+    return suite.run();
+}
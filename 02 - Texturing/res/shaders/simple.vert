@@ -7,8 +7,7 @@
 // In
 in layout(location = 0) vec3 in_position;
 in layout(location = 1) vec3 in_normal;
-in layout(location = 2) vec3 in_tangent;
-in layout(location = 3) vec3 in_bitangent;
+in layout(location = 2) vec4 in_tangent; // w is the handedness of the tangent frame (+1 or -1)
 in layout(location = 4) vec2 in_texture_coordinates;
 
 uniform layout(location = 0) int geometry_type; // 2D/3D/NormalMapped object
@@ -37,10 +36,15 @@ void main()
         gl_Position = MVP * vec4(in_position, 1);
     }
 
+    // The bitangent is not stored, it follows from the normal, the tangent and its handedness
+    vec3 tangent   = normalize(in_tangent.xyz);
+    vec3 normal    = normalize(in_normal);
+    vec3 bitangent = cross(normal, tangent) * in_tangent.w;
+
     // Pass values to Fragment Shader
     out_geometry_mode       = geometry_type;
     out_fragment_position   = vec3(M * vec4(in_position, 1));
     out_normal              = normalize(N * in_normal);
-    TBN                     = mat3(normalize(in_tangent), normalize(in_bitangent), normalize(in_normal));
+    TBN                     = mat3(tangent, bitangent, normal);
     out_texture_coordinates = in_texture_coordinates;
 }
@@ -0,0 +1,16 @@
+#version 430 core
+
+// In
+in layout(location = 0) vec2 in_texture_coordinates;
+
+uniform layout(binding = 0) sampler2D charmap;
+
+// Out
+out vec4 color;
+
+
+
+void main()
+{
+    color = texture(charmap, in_texture_coordinates);
+}
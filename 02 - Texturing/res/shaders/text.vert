@@ -0,0 +1,18 @@
+#version 430 core
+
+// In
+in layout(location = 0) vec2 in_position;
+in layout(location = 1) vec2 in_texture_coordinates;
+
+uniform layout(location = 0) mat4 O; // Orthogonal Matrix
+
+// Out
+out layout(location = 0) vec2 out_texture_coordinates;
+
+
+
+void main()
+{
+    gl_Position             = O * vec4(in_position, 0, 1);
+    out_texture_coordinates = in_texture_coordinates;
+}
@@ -1,8 +1,10 @@
 #include <GLFW/glfw3.h>
 #include <SFML/Audio/Sound.hpp>
 #include <SFML/Audio/SoundBuffer.hpp>
+#include <algorithm>
 #include <chrono>
 #include <fmt/format.h>
+#include <future>
 #include <glad/glad.h>
 #include <iostream>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -15,6 +17,7 @@
 #include "sceneGraph.hpp"
 #include "utilities/glfont.h"
 #include "utilities/imageLoader.hpp"
+#include "utilities/textBatcher.h"
 #include <timestamps.h>
 #include <utilities/glutils.h>
 #include <utilities/mesh.h>
@@ -62,6 +65,12 @@ glm::vec3 ballDirection(1, 1, 0.2f);
 
 const glm::vec3 cameraPosition(0, 2, -20);
 
+// The game is updated in fixed steps, independent of the frame rate
+const double tickSeconds = 1.0 / 240.0;
+double tickAccumulator   = 0;
+// Where the ball was before the latest tick, the ball is drawn between this and ballPosition
+glm::vec3 previousBallPosition = ballPosition;
+
 
 
 SceneNode *root;
@@ -72,12 +81,10 @@ SceneNode *ball;
 unsigned const int numLights = 1;
 std::vector<SceneNode *> lights(numLights);
 
-SceneNode *text;
-
-PNGImage imageCharmap        = loadPNGFile("../res/textures/charmap.png");
-PNGImage imageBrickColor     = loadPNGFile("../res/textures/Brick03_col.png");
-PNGImage imageBrickNormal    = loadPNGFile("../res/textures/Brick03_nrm.png");
-PNGImage imageBrickRoughness = loadPNGFile("../res/textures/Brick03_rgh.png");
+// All on-screen text is redrawn every frame through this
+TextBatcher *textBatcher;
+// Smoothed time between frames, shown on screen
+double frameSeconds = 1.0 / 60.0;
 
 unsigned int charmapID;
 unsigned int brickColorID;
@@ -111,6 +118,22 @@ void mouseCallback(GLFWwindow *window, double x, double y)
 
 
 
+/**
+ * @brief Size of what is rendered to, the window or the offscreen framebuffer when running headless
+ */
+void getScreenSize(GLFWwindow *window, int *width, int *height)
+{
+    if (window == nullptr)
+    {
+        *width  = options.headlessWidth;
+        *height = options.headlessHeight;
+        return;
+    }
+    glfwGetWindowSize(window, width, height);
+}
+
+
+
 /**
  * @brief Initialize a texture and reutrn its ID
  *
@@ -151,7 +174,7 @@ SceneNode *initNodeFromMesh(
     int textureIDRoughness = -1)
 {
     SceneNode *node     = createSceneNode();
-    node->vaoID         = generateBuffer(mesh);
+    node->vaoID         = generateBuffer(mesh, node->vaoIndexType);
     node->vaoIndexCount = mesh.indices.size();
 
     if (textureID != -1) node->type = GEOMETRY_TEXTURED;
@@ -171,13 +194,21 @@ SceneNode *initNodeFromMesh(
  */
 void initGame(GLFWwindow *window, CommandLineOptions gameOptions)
 {
-    buffer = new sf::SoundBuffer();
-    if (!buffer->loadFromFile("../res/Hall of the Mountain King.ogg")) return;
-
     options = gameOptions;
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
-    glfwSetCursorPosCallback(window, mouseCallback);
+    // The music is only loaded when it is going to be played
+    if (options.enableMusic)
+    {
+        buffer = new sf::SoundBuffer();
+        if (!buffer->loadFromFile("../res/Hall of the Mountain King.ogg")) return;
+    }
+
+    // There is no window (and no mouse) when running headless
+    if (window != nullptr)
+    {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
+        glfwSetCursorPosCallback(window, mouseCallback);
+    }
 
     shader = new Gloom::Shader();
     shader->makeBasicShader("../res/shaders/simple.vert", "../res/shaders/simple.frag");
@@ -198,29 +229,39 @@ void initGame(GLFWwindow *window, CommandLineOptions gameOptions)
  */
 void initObjects()
 {
+    // The textures are decoded on their own threads while the meshes are made, only the uploads need the OpenGL context
+    auto decode                          = [](std::string fileName) { return std::async(std::launch::async, loadPNGFile, fileName); };
+    std::future<PNGImage> charmap        = decode("../res/textures/charmap.png");
+    std::future<PNGImage> brickColor     = decode("../res/textures/Brick03_col.png");
+    std::future<PNGImage> brickNormal    = decode("../res/textures/Brick03_nrm.png");
+    std::future<PNGImage> brickRoughness = decode("../res/textures/Brick03_rgh.png");
+
+    Mesh boxMesh  = cube(boxDimensions, glm::vec2(90), true, true);
+    Mesh padMesh  = cube(padDimensions, glm::vec2(30, 30), true);
+    Mesh ballMesh = generateSphere(1.0, 40, 40);
+
     // Initialize all textures
-    charmapID        = initTexture(imageCharmap);
-    brickColorID     = initTexture(imageBrickColor);
-    brickNormalID    = initTexture(imageBrickNormal);
-    brickRoughnessID = initTexture(imageBrickRoughness);
+    charmapID        = initTexture(charmap.get());
+    brickColorID     = initTexture(brickColor.get());
+    brickNormalID    = initTexture(brickNormal.get());
+    brickRoughnessID = initTexture(brickRoughness.get());
 
     // Construct Objects
-    box  = initNodeFromMesh(cube(boxDimensions, glm::vec2(90), true, true), brickColorID, brickNormalID, brickRoughnessID);
-    pad  = initNodeFromMesh(cube(padDimensions, glm::vec2(30, 30), true));
-    ball = initNodeFromMesh(generateSphere(1.0, 40, 40));
+    box  = initNodeFromMesh(boxMesh, brickColorID, brickNormalID, brickRoughnessID);
+    pad  = initNodeFromMesh(padMesh);
+    ball = initNodeFromMesh(ballMesh);
 
     // Construct Lights
     for (auto &light : lights) light = createLightNode(POINT_LIGHT);
 
-    // Add 2D Objects
-    text = createTextNode(0.1f, 0.5f, "Hello World", 420);
+    // All 2D text is batched into a single draw every frame
+    textBatcher = new TextBatcher();
 
     // Build SceneGraph
     addChild(root, box);
     addChild(root, pad);
     addChild(root, ball);
     addChild(ball, lights[0]);
-    addChild(root, text);
 
     // Place Objects in their initial positions (relative to their parent) where:
     //      x = left/right          positive = right
@@ -237,6 +278,7 @@ void initObjects()
 
 /**
  * @brief Create a 2D SceneNode object that loads the charmap texture to display some text.
+ * This creates new buffers every time, so it is only meant for text that never changes, use textBatcher for the rest.
  *
  * @param x Horisontal position: Value between 0 and 1
  * @param y Vertical position: Value between 0 and 1
@@ -262,11 +304,27 @@ SceneNode *createTextNode(float x, float y, std::string text, unsigned int width
  */
 void updateFrame(GLFWwindow *window)
 {
-    updateGameState(window);
+    // Run as many fixed ticks as fit in the time since last frame, the rest is carried over to the next frame.
+    // A very long frame (window dragged, breakpoint) is capped, so the game does not jump far ahead
+    // Headless runs always advance one 60 fps frame, so every run plays out the same
+    double frameDelta = options.headless ? 1.0 / 60.0 : getTimeDeltaSeconds();
+    tickAccumulator += std::min(frameDelta, 0.25);
+    frameSeconds = glm::mix(frameSeconds, frameDelta, 0.05);
+    while (tickAccumulator >= tickSeconds)
+    {
+        previousBallPosition = ballPosition;
+        updateGameState(window, tickSeconds);
+        tickAccumulator -= tickSeconds;
+    }
+    // Draw the ball where it is between the last two ticks, so it moves smoothly at any frame rate
+    float alpha    = float(tickAccumulator / tickSeconds);
+    ball->position = glm::mix(previousBallPosition, ballPosition, alpha);
 
     float lookRotation = -0.6 / (1 + exp(-5 * (padPositionX - 0.5))) + 0.3; // Some math to make the camera move in a nice way
     // Calculating ViewProjection Matrix
-    glm::mat4 projection = glm::perspective(glm::radians(80.0f), float(windowWidth) / float(windowHeight), 0.1f, 350.f);
+    int screenWidth, screenHeight;
+    getScreenSize(window, &screenWidth, &screenHeight);
+    glm::mat4 projection = glm::perspective(glm::radians(80.0f), float(screenWidth) / float(screenHeight), 0.1f, 350.f);
 
     glm::mat4 view = glm::rotate(0.3f + 0.2f * float(-padPositionZ * padPositionZ), glm::vec3(1, 0, 0))
                    * glm::rotate(lookRotation, glm::vec3(0, 1, 0))
@@ -327,9 +385,12 @@ void updateNodeTransformations(SceneNode *node, glm::mat4 M, glm::mat4 VP)
 void renderFrame(GLFWwindow *window)
 {
     int windowWidth, windowHeight;
-    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+    getScreenSize(window, &windowWidth, &windowHeight);
     glViewport(0, 0, windowWidth, windowHeight);
 
+    // The text batcher uses its own shader
+    shader->activate();
+
     // Pass Camera Position to Fragment Shader (for specular highlights)
     glUniform3fv(shader->getUniformFromName("camera_position"), 1, glm::value_ptr(cameraPosition));
     // Pass Ball Position and Radius to Fragment shader (for shadows)
@@ -340,6 +401,12 @@ void renderFrame(GLFWwindow *window)
     glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(orthoMatrix));
 
     renderNode(root);
+
+    // Text that changes every frame, all drawn at once
+    textBatcher->begin(windowWidth, windowHeight);
+    textBatcher->addText(0.02f, 0.94f, fmt::format("Time {:.1f}", gameElapsedTime), 200);
+    textBatcher->addText(0.02f, 0.89f, fmt::format("{:.0f} fps", 1.0 / std::max(frameSeconds, 1e-6)), 120);
+    textBatcher->draw(charmapID);
 }
 
 
@@ -361,14 +428,14 @@ void renderNode(SceneNode *node)
                 glBindTextureUnit(0, node->textureID);
 
                 glBindVertexArray(node->vaoID);
-                glDrawElements(GL_TRIANGLES, node->vaoIndexCount, GL_UNSIGNED_INT, nullptr);
+                glDrawElements(GL_TRIANGLES, node->vaoIndexCount, node->vaoIndexType, nullptr);
             }
             break;
         case GEOMETRY_3D:
             if (node->vaoID != -1)
             {
                 glBindVertexArray(node->vaoID);
-                glDrawElements(GL_TRIANGLES, node->vaoIndexCount, GL_UNSIGNED_INT, nullptr);
+                glDrawElements(GL_TRIANGLES, node->vaoIndexCount, node->vaoIndexType, nullptr);
             }
             break;
         case GEOMETRY_TEXTURED:
@@ -380,7 +447,7 @@ void renderNode(SceneNode *node)
                 glBindTextureUnit(2, node->textureIDRoughness);
 
                 glBindVertexArray(node->vaoID);
-                glDrawElements(GL_TRIANGLES, node->vaoIndexCount, GL_UNSIGNED_INT, nullptr);
+                glDrawElements(GL_TRIANGLES, node->vaoIndexCount, node->vaoIndexType, nullptr);
             }
             break;
         case POINT_LIGHT:
@@ -404,13 +471,14 @@ void renderNode(SceneNode *node)
 /**
  * @brief Updates positions/rotations, checks for colissions, if game is paused etc.
  *
+ * @param window
+ * @param timeDelta Seconds to advance the game, always the same fixed tick
  */
-void updateGameState(GLFWwindow *window)
+void updateGameState(GLFWwindow *window, double timeDelta)
 {
-    double timeDelta = getTimeDeltaSeconds();
-
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1))
+    if (window != nullptr) glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // Headless there is nobody to click, so the game starts right away
+    if (window == nullptr ? !hasStarted : glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1))
     {
         mouseLeftPressed  = true;
         mouseLeftReleased = false;
@@ -420,7 +488,7 @@ void updateGameState(GLFWwindow *window)
         mouseLeftReleased = mouseLeftPressed;
         mouseLeftPressed  = false;
     }
-    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2))
+    if (window != nullptr && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2))
     {
         mouseRightPressed  = true;
         mouseRightReleased = false;
@@ -6,10 +6,11 @@
 
 void initGame(GLFWwindow *window, CommandLineOptions options);
 void initObjects();
+void getScreenSize(GLFWwindow *window, int *width, int *height);
 unsigned int initTexture(PNGImage texture);
 SceneNode *createTextNode(float x, float y, std::string text, unsigned int width);
 void updateFrame(GLFWwindow *window);
-void updateGameState(GLFWwindow *window);
+void updateGameState(GLFWwindow *window, double timeDelta);
 void updateNodeTransformations(SceneNode *node, glm::mat4 M, glm::mat4 VP);
 void renderFrame(GLFWwindow *window);
 void renderNode(SceneNode *node);
\ No newline at end of file
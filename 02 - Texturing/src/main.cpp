@@ -1,5 +1,6 @@
 // Local headers
 #include "program.hpp"
+#include "utilities/headless.h"
 #include "utilities/window.hpp"
 
 // System headers
@@ -67,6 +68,10 @@ int main(int argc, const char *argb[])
     const auto &showHelp       = parser.add<bool>("help", "Show this help message.", 'h', arrrgh::Optional, false);
     const auto &enableMusic    = parser.add<bool>("enable-music", "Play background music while the game is playing", 'm', arrrgh::Optional, false);
     const auto &enableAutoplay = parser.add<bool>("autoplay", "Let the game play itself automatically. Useful for testing.", 'a', arrrgh::Optional, false);
+    const auto &headless       = parser.add<bool>("headless", "Render offscreen without a window (needs EGL), the game plays itself. Exits when done.", 'x', arrrgh::Optional, false);
+    const auto &frames         = parser.add<int>("frames", "Number of frames to render in headless mode.", 'f', arrrgh::Optional, 100);
+    const auto &width          = parser.add<int>("width", "Width of the offscreen framebuffer in headless mode.", 'W', arrrgh::Optional, windowWidth);
+    const auto &height         = parser.add<int>("height", "Height of the offscreen framebuffer in headless mode.", 'H', arrrgh::Optional, windowHeight);
 
     // If you want to add more program arguments, define them here,
     // but do not request their value here (they have not been parsed yet at this point).
@@ -91,6 +96,26 @@ int main(int argc, const char *argb[])
     CommandLineOptions options;
     options.enableMusic    = enableMusic.value();
     options.enableAutoplay = enableAutoplay.value();
+    options.headless       = headless.value();
+    options.headlessFrames = frames.value();
+    options.headlessWidth  = width.value();
+    options.headlessHeight = height.value();
+
+    if (options.headless)
+    {
+        // Nobody is there to listen or play
+        options.enableMusic    = false;
+        options.enableAutoplay = true;
+
+        if (!createHeadlessContext())
+        {
+            destroyHeadlessContext();
+            return EXIT_FAILURE;
+        }
+        runHeadless(options);
+        destroyHeadlessContext();
+        return EXIT_SUCCESS;
+    }
 
     // Initialise window using GLFW
     GLFWwindow *window = initialise();
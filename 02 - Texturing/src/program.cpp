@@ -7,6 +7,8 @@
 // glm::translate, glm::rotate, glm::scale, glm::perspective
 #include <SFML/Audio.hpp>
 #include <SFML/System/Time.hpp>
+#include <algorithm>
+#include <chrono>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
@@ -15,7 +17,8 @@
 #include <utilities/shapes.h>
 #include <utilities/timeutils.h>
 
-void runProgram(GLFWwindow *window, CommandLineOptions options)
+// Settings shared by the window and headless mode
+static void configureOpenGL()
 {
     // Enable depth (Z) buffer (accept "closest" fragment)
     glEnable(GL_DEPTH_TEST);
@@ -33,7 +36,11 @@ void runProgram(GLFWwindow *window, CommandLineOptions options)
 
     // Set default colour after clearing the colour buffer
     glClearColor(0.3f, 0.5f, 0.8f, 1.0f);
+}
 
+void runProgram(GLFWwindow *window, CommandLineOptions options)
+{
+    configureOpenGL();
     initGame(window, options);
 
     // Rendering Loop
@@ -54,6 +61,48 @@ void runProgram(GLFWwindow *window, CommandLineOptions options)
     }
 }
 
+void runHeadless(CommandLineOptions options)
+{
+    configureOpenGL();
+
+    // Offscreen framebuffer that takes the place of the window
+    unsigned int framebufferID, colorID, depthID;
+    glCreateRenderbuffers(1, &colorID);
+    glNamedRenderbufferStorage(colorID, GL_RGBA8, options.headlessWidth, options.headlessHeight);
+    glCreateRenderbuffers(1, &depthID);
+    glNamedRenderbufferStorage(depthID, GL_DEPTH_COMPONENT24, options.headlessWidth, options.headlessHeight);
+    glCreateFramebuffers(1, &framebufferID);
+    glNamedFramebufferRenderbuffer(framebufferID, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorID);
+    glNamedFramebufferRenderbuffer(framebufferID, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthID);
+    if (glCheckNamedFramebufferStatus(framebufferID, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Could not create the offscreen framebuffer\n");
+        return;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+
+    initGame(nullptr, options);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.headlessFrames; frame++)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        updateFrame(nullptr);
+        renderFrame(nullptr);
+        // There is no swap to wait for, so wait for the GPU to finish the frame here
+        glFinish();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Rendered %d frames (%dx%d) in %.3f s, %.3f ms per frame\n",
+           options.headlessFrames, options.headlessWidth, options.headlessHeight,
+           seconds, 1000.0 * seconds / std::max(1, options.headlessFrames));
+    printGLError();
+
+    glDeleteFramebuffers(1, &framebufferID);
+    glDeleteRenderbuffers(1, &colorID);
+    glDeleteRenderbuffers(1, &depthID);
+}
+
 void handleKeyboardInput(GLFWwindow *window)
 {
     // Use escape key for terminating the GLFW window
@@ -11,6 +11,9 @@
 // Main OpenGL program
 void runProgram(GLFWwindow *window, CommandLineOptions options);
 
+// Renders options.headlessFrames frames offscreen (needs a current context, but no window)
+void runHeadless(CommandLineOptions options);
+
 // Function for handling keypresses
 void handleKeyboardInput(GLFWwindow *window);
 
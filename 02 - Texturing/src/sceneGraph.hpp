@@ -1,5 +1,6 @@
 #pragma once
 
+#include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/mat4x4.hpp>
@@ -32,6 +33,7 @@ struct SceneNode
         referencePoint     = glm::vec3(0, 0, 0);
         type               = GEOMETRY_3D;
         vaoIndexCount      = 0;
+        vaoIndexType       = GL_UNSIGNED_INT;
         vaoID              = -1;
         lightID            = -1;
         textureID          = -1;
@@ -60,6 +62,8 @@ struct SceneNode
     int vaoID;
     // Number of indices for mesh
     unsigned int vaoIndexCount;
+    // Type of the indices, GL_UNSIGNED_SHORT when the mesh has few enough vertices
+    unsigned int vaoIndexType;
     // Node type is used to determine how to handle the contents of a node
     SceneNodeType type;
 
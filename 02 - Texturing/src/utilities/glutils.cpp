@@ -1,20 +1,42 @@
 #include "glutils.h"
+#include "vertexLayout.hpp"
 #include <glad/glad.h>
 #include <program.hpp>
 #include <vector>
 
 #define OUT
 
-template <class T>
-unsigned int generateAttribute(int id, int elementsPerEntry, std::vector<T> data, bool normalize)
+// One vertex as it is stored on the GPU (24 bytes), all attributes interleaved in a single buffer (locations as in simple.vert).
+// The bitangent is not stored, simple.vert computes it from the normal and the tangent, flipped by the handedness in tangent.w
+struct Vertex
 {
-    unsigned int bufferID;
-    glGenBuffers(1, &bufferID);
-    glBindBuffer(GL_ARRAY_BUFFER, bufferID);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(T), data.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(id, elementsPerEntry, GL_FLOAT, normalize ? GL_TRUE : GL_FALSE, sizeof(T), 0);
-    glEnableVertexAttribArray(id);
-    return bufferID;
+    glm::vec3 position;
+    PackedSnorm4 normal;
+    PackedSnorm4 tangent;
+    PackedHalf2 textureCoordinates;
+};
+
+const VertexLayout vertexLayout = VertexLayout::of<Vertex>()
+                                      .add(0, &Vertex::position)
+                                      .add(1, &Vertex::normal, true)
+                                      .add(2, &Vertex::tangent, true)
+                                      .add(4, &Vertex::textureCoordinates);
+
+glm::vec3 safeNormalize(glm::vec3 vector)
+{
+    float length = glm::length(vector);
+    return 0 < length ? vector / length : glm::vec3(0);
+}
+
+/**
+ * @brief The tangent made a unit vector orthogonal to the normal, with the handedness of the tangent frame in w
+ * (-1 when the bitangent points the opposite way of cross(normal, tangent))
+ */
+glm::vec4 tangentFrame(glm::vec3 normal, glm::vec3 tangent, glm::vec3 bitangent)
+{
+    tangent          = safeNormalize(tangent - normal * glm::dot(normal, tangent));
+    float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0 ? -1.0f : 1.0f;
+    return glm::vec4(tangent, handedness);
 }
 
 /**
@@ -73,27 +95,49 @@ void computeTangentBasis(
 }
 
 
-unsigned int generateBuffer(Mesh &mesh)
+unsigned int generateBuffer(Mesh &mesh, unsigned int &indexType)
 {
-    unsigned int vaoID;
-    glGenVertexArrays(1, &vaoID);
-    glBindVertexArray(vaoID);
-
-    generateAttribute(0, 3, mesh.vertices, false);
-    generateAttribute(1, 3, mesh.normals, true);
+    std::vector<glm::vec3> tangents, bitangents;
     if (mesh.textureCoordinates.size() > 0)
     {
-        std::vector<glm::vec3> tangents, bitangents;
         computeTangentBasis(mesh.vertices, mesh.textureCoordinates, tangents, bitangents);
-        generateAttribute(2, 3, tangents, true);
-        generateAttribute(3, 3, bitangents, true);
-        generateAttribute(4, 2, mesh.textureCoordinates, false);
     }
 
-    unsigned int indexBufferID;
-    glGenBuffers(1, &indexBufferID);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
+    // Interleave and pack all attributes into one buffer, missing ones are left as zero
+    std::vector<Vertex> vertices(mesh.vertices.size(), Vertex());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        glm::vec3 normal     = i < mesh.normals.size() ? safeNormalize(mesh.normals[i]) : glm::vec3(0);
+        vertices[i].position = mesh.vertices[i];
+        vertices[i].normal   = glm::vec4(normal, 0);
+        if (i < tangents.size()) vertices[i].tangent = tangentFrame(normal, tangents[i], bitangents[i]);
+        if (i < mesh.textureCoordinates.size()) vertices[i].textureCoordinates = mesh.textureCoordinates[i];
+    }
+
+    unsigned int vaoID;
+    glCreateVertexArrays(1, &vaoID);
+    if (vertices.empty() || mesh.indices.empty()) return vaoID;
+
+    // One immutable buffer for the vertices and one for the indices
+    unsigned int buffers[2];
+    glCreateBuffers(2, buffers);
+    glNamedBufferStorage(buffers[0], vertices.size() * sizeof(Vertex), vertices.data(), 0);
+    if (vertices.size() <= 0x10000)
+    {
+        // 16 bit indices are enough for every vertex, and take half the memory and bandwidth
+        std::vector<unsigned short> shortIndices(mesh.indices.begin(), mesh.indices.end());
+        glNamedBufferStorage(buffers[1], shortIndices.size() * sizeof(unsigned short), shortIndices.data(), 0);
+        indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        glNamedBufferStorage(buffers[1], mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), 0);
+        indexType = GL_UNSIGNED_INT;
+    }
+
+    glVertexArrayVertexBuffer(vaoID, 0, buffers[0], 0, vertexLayout.stride);
+    glVertexArrayElementBuffer(vaoID, buffers[1]);
+    vertexLayout.apply(vaoID, 0);
 
     return vaoID;
 }
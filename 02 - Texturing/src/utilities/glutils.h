@@ -2,4 +2,8 @@
 
 #include "mesh.h"
 
-unsigned int generateBuffer(Mesh &mesh);
\ No newline at end of file
+unsigned int generateBuffer(Mesh &mesh, unsigned int &indexType);
+void computeTangentBasis(std::vector<glm::vec3> &vertices,
+                         std::vector<glm::vec2> &uvs,
+                         std::vector<glm::vec3> &tangents,
+                         std::vector<glm::vec3> &bitangents);
@@ -0,0 +1,7 @@
+#pragma once
+
+// Offscreen OpenGL context without any window (EGL on a surfaceless display, Mesa llvmpipe works).
+// Only available when built with EGL (HAS_EGL), otherwise createHeadlessContext() fails.
+// Creates the context, makes it current and loads OpenGL, returns false if any of it failed
+bool createHeadlessContext();
+void destroyHeadlessContext();
@@ -6,14 +6,18 @@ PNGImage loadPNGFile(std::string fileName)
 {
     std::vector<unsigned char> png;
     std::vector<unsigned char> pixels; // the raw pixels
-    unsigned int width, height;
+    unsigned int width = 0, height = 0;
 
     // load and decode
     unsigned error = lodepng::load_file(png, fileName);
     if (!error) error = lodepng::decode(pixels, width, height, png);
 
     // if there's an error, display it
-    if (error) std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+    if (error)
+    {
+        std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+        return PNGImage { 0, 0, {} };
+    }
 
     // the pixels are now in the vector "image", 4 bytes per pixel, ordered RGBARGBA..., use it as texture, draw it, ...
 
@@ -0,0 +1,127 @@
+#include "textBatcher.h"
+
+#include <cstddef>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+// Size of a glyph in the charmap, which has all 128 ASCII characters in one row
+const float glyphAspect        = 39.0f / 29.0f;
+const float textureGlyphWidth  = 1.0f / 128.0f;
+const float textureGlyphHeight = 1.0f;
+
+TextBatcher::TextBatcher(unsigned int maxGlyphs)
+{
+    // Indices are 16 bit, and one region of vertices must be reachable from its base vertex
+    this->maxGlyphs = glm::min(maxGlyphs, 65536u / 4);
+
+    shader = new Gloom::Shader();
+    shader->makeBasicShader("../res/shaders/text.vert", "../res/shaders/text.frag");
+
+    // Vertices for every region, mapped once for the lifetime of the batcher
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size  = GLsizeiptr(regions) * this->maxGlyphs * 4 * sizeof(TextVertex);
+    glCreateBuffers(1, &vertexBufferID);
+    glNamedBufferStorage(vertexBufferID, size, nullptr, flags);
+    vertices = static_cast<TextVertex *>(glMapNamedBufferRange(vertexBufferID, 0, size, flags));
+
+    // Two triangles per glyph, the same for every region since they are drawn with a base vertex
+    std::vector<unsigned short> indices(this->maxGlyphs * 6);
+    for (unsigned int i = 0; i < this->maxGlyphs; i++)
+    {
+        indices[6 * i + 0] = 4 * i + 0;
+        indices[6 * i + 1] = 4 * i + 1;
+        indices[6 * i + 2] = 4 * i + 2;
+        indices[6 * i + 3] = 4 * i + 0;
+        indices[6 * i + 4] = 4 * i + 2;
+        indices[6 * i + 5] = 4 * i + 3;
+    }
+    glCreateBuffers(1, &indexBufferID);
+    glNamedBufferStorage(indexBufferID, indices.size() * sizeof(unsigned short), indices.data(), 0);
+
+    glCreateVertexArrays(1, &vaoID);
+    glVertexArrayVertexBuffer(vaoID, 0, vertexBufferID, 0, sizeof(TextVertex));
+    glVertexArrayElementBuffer(vaoID, indexBufferID);
+
+    glEnableVertexArrayAttrib(vaoID, 0);
+    glVertexArrayAttribFormat(vaoID, 0, 2, GL_FLOAT, GL_FALSE, offsetof(TextVertex, position));
+    glVertexArrayAttribBinding(vaoID, 0, 0);
+
+    glEnableVertexArrayAttrib(vaoID, 1);
+    glVertexArrayAttribFormat(vaoID, 1, 2, GL_FLOAT, GL_FALSE, offsetof(TextVertex, textureCoordinates));
+    glVertexArrayAttribBinding(vaoID, 1, 0);
+}
+
+TextBatcher::~TextBatcher()
+{
+    for (GLsync fence : fences)
+        if (fence) glDeleteSync(fence);
+    glUnmapNamedBuffer(vertexBufferID);
+    glDeleteBuffers(1, &vertexBufferID);
+    glDeleteBuffers(1, &indexBufferID);
+    glDeleteVertexArrays(1, &vaoID);
+    shader->destroy();
+    delete shader;
+}
+
+
+
+void TextBatcher::begin(int screenWidth, int screenHeight)
+{
+    this->screenWidth  = glm::max(screenWidth, 1);
+    this->screenHeight = glm::max(screenHeight, 1);
+    region             = (region + 1) % regions;
+    glyphs             = 0;
+
+    // Normally this region was drawn two frames ago and is long done
+    GLsync &fence = fences[region];
+    if (fence)
+    {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void TextBatcher::addText(float x, float y, std::string const &text, unsigned int width)
+{
+    if (text.empty()) return;
+    float characterWidth  = float(width) / float(screenWidth * text.length());
+    float characterHeight = glyphAspect * float(width) / float(screenHeight * text.length());
+
+    TextVertex *regionVertices = vertices + size_t(region) * maxGlyphs * 4;
+    for (unsigned int i = 0; i < text.length() && glyphs < maxGlyphs; i++)
+    {
+        unsigned char character = text[i];
+        if (character == ' ') continue;
+        if (character >= 128) character = '?';
+
+        float left     = x + float(i) * characterWidth;
+        float textureX = float(character) * textureGlyphWidth;
+
+        TextVertex *quad = regionVertices + 4 * glyphs++;
+        quad[0] = { { left, y }, { textureX, 0 } };
+        quad[1] = { { left + characterWidth, y }, { textureX + textureGlyphWidth, 0 } };
+        quad[2] = { { left + characterWidth, y + characterHeight }, { textureX + textureGlyphWidth, textureGlyphHeight } };
+        quad[3] = { { left, y + characterHeight }, { textureX, textureGlyphHeight } };
+    }
+}
+
+void TextBatcher::draw(unsigned int charmapID)
+{
+    if (glyphs == 0) return;
+
+    // (0,0) is bottom left and (1,1) is top right, text is always on top of the scene
+    glm::mat4 orthoMatrix = glm::ortho(0.0f, 1.0f, 0.0f, 1.0f, -1.0f, 1.0f);
+    shader->activate();
+    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(orthoMatrix));
+    glBindTextureUnit(0, charmapID);
+    glBindVertexArray(vaoID);
+
+    glDisable(GL_DEPTH_TEST);
+    GLint baseVertex = GLint(region * maxGlyphs * 4);
+    glDrawElementsBaseVertex(GL_TRIANGLES, glyphs * 6, GL_UNSIGNED_SHORT, nullptr, baseVertex);
+    glEnable(GL_DEPTH_TEST);
+
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
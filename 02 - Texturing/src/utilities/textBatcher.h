@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+
+#include "shader.hpp"
+
+// Vertex format of the batched text, only what a textured quad needs
+struct TextVertex
+{
+    glm::vec2 position;           // 0 to 1, (0,0) is bottom left
+    glm::vec2 textureCoordinates; // in the charmap texture
+};
+
+/**
+ * Draws all text of a frame with a single draw call, without creating any buffers after startup.
+ *
+ * The glyph quads are written straight into a buffer that stays mapped (persistent mapping). The buffer is split into
+ * a few regions that are used in turn, one per frame, and a fence after each frame's draw tells when the GPU is done
+ * reading a region so it can be written again. The indices never change, so they are created once.
+ *
+ *      textBatcher->begin(screenWidth, screenHeight);
+ *      textBatcher->addText(0.02f, 0.95f, "Score 10", 160);
+ *      textBatcher->draw(charmapID);
+ */
+class TextBatcher
+{
+public:
+    /**
+     * @param maxGlyphs Most glyphs that can be drawn in one frame, any more are dropped
+     */
+    TextBatcher(unsigned int maxGlyphs = 4096);
+    ~TextBatcher();
+
+    /** Start a new frame of text, waits if the GPU is still reading the region from a few frames ago */
+    void begin(int screenWidth, int screenHeight);
+
+    /**
+     * @brief Add a line of text, in the same charmap font as generateTextGeometryBuffer
+     *
+     * @param x Horisontal position of the bottom left corner: Value between 0 and 1
+     * @param y Vertical position of the bottom left corner: Value between 0 and 1
+     * @param text The text to be rendered
+     * @param width width of text (pixels)
+     */
+    void addText(float x, float y, std::string const &text, unsigned int width);
+
+    /** Draw everything added since begin(), changes the active shader program */
+    void draw(unsigned int charmapID);
+
+private:
+    // Disable copying and assignment
+    TextBatcher(TextBatcher const &) = delete;
+    TextBatcher &operator=(TextBatcher const &) = delete;
+
+    // Frames that may be in flight at once, each has its own region of the vertex buffer
+    static const unsigned int regions = 3;
+
+    Gloom::Shader *shader;
+    unsigned int maxGlyphs;
+    GLuint vaoID;
+    GLuint vertexBufferID;
+    GLuint indexBufferID;
+    TextVertex *vertices; // the mapped vertex buffer, all regions
+    GLsync fences[regions] = {};
+
+    unsigned int region = 0;
+    unsigned int glyphs = 0;
+    int screenWidth     = 1;
+    int screenHeight    = 1;
+};
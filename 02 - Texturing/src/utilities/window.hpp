@@ -17,4 +17,10 @@ struct CommandLineOptions
 {
     bool enableMusic;
     bool enableAutoplay;
+
+    // Render offscreen for a number of frames and exit, instead of opening a window
+    bool headless;
+    int headlessFrames;
+    int headlessWidth;
+    int headlessHeight;
 };
\ No newline at end of file
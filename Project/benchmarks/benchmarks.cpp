@@ -0,0 +1,146 @@
+#include <cstdlib>
+#include <string>
+
+#include "benchmark.hpp"
+#include "classes/image.hpp"
+#include "classes/mesh.hpp"
+#include "classes/sceneNode.hpp"
+#include "classes/threadPool.hpp"
+#include "utilities/meshOptimizer.hpp"
+#include "utilities/shapes.hpp"
+#include "utilities/tangents.hpp"
+
+// Files used by the cases, relative to the build directory like the program itself
+const std::string modelFile = "marble_bust/marble_bust_01_1k.gltf";
+const std::string imageFile = "../res/cubemaps/lake/front.jpg";
+
+
+
+void printUsage(const char *program)
+{
+    printf("Usage: %s [--filter TEXT] [--json FILE] [--samples N] [--sample-time MS] [--warmup MS]\n", program);
+    printf("  --filter       Only run cases whose name contains TEXT\n");
+    printf("  --json         Where to write the results (default benchmarks.json, empty to disable)\n");
+    printf("  --samples      Number of timed samples per case (default 30)\n");
+    printf("  --sample-time  Shortest duration of a sample in milliseconds (default 20)\n");
+    printf("  --warmup       Time each case runs before it is measured in milliseconds (default 200)\n");
+}
+
+BENCHMARK::Settings parseArguments(int argc, const char *argb[])
+{
+    BENCHMARK::Settings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argb[i];
+        bool hasValue        = i + 1 < argc;
+        if (argument == "--filter" && hasValue)
+            settings.filter = argb[++i];
+        else if (argument == "--json" && hasValue)
+            settings.jsonFile = argb[++i];
+        else if (argument == "--samples" && hasValue)
+            settings.samples = std::atoi(argb[++i]);
+        else if (argument == "--sample-time" && hasValue)
+            settings.sampleSeconds = std::atof(argb[++i]) / 1000.0;
+        else if (argument == "--warmup" && hasValue)
+            settings.warmupSeconds = std::atof(argb[++i]) / 1000.0;
+        else
+        {
+            printUsage(argb[0]);
+            exit(argument == "--help" ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    return settings;
+}
+
+
+
+int main(int argc, const char *argb[])
+{
+    BENCHMARK::Suite suite(parseArguments(argc, argb));
+
+    // Loading and decoding
+    suite.add("mesh/load glTF", []() {
+        Mesh mesh(modelFile);
+        BENCHMARK::doNotOptimize(mesh.vertices.data());
+    });
+    suite.add("image/decode", []() {
+        Image image(imageFile);
+        BENCHMARK::doNotOptimize(image.pixels.data());
+    });
+
+    // Image operations, done in place on the same image over and over
+    Image image(imageFile);
+    suite.add("image/flipY", [&]() {
+        image.flipY();
+        BENCHMARK::doNotOptimize(image.pixels.data());
+    });
+    suite.add("image/rotate90ClockWise", [&]() {
+        image.rotate90ClockWise();
+        BENCHMARK::doNotOptimize(image.pixels.data());
+    });
+
+    // Generated shapes
+    suite.add("shapes/Sphere", []() {
+        Mesh mesh = SHAPES::Sphere(1);
+        BENCHMARK::doNotOptimize(mesh.vertices.data());
+    });
+    suite.add("shapes/Cylinder", []() {
+        Mesh mesh = SHAPES::Cylinder(1, 2);
+        BENCHMARK::doNotOptimize(mesh.vertices.data());
+    });
+
+    // Tangents of the model, which is what the program computes them for, on one thread and split over a pool
+    Mesh bust(modelFile);
+    suite.add("tangents/generate", [&]() {
+        Mesh mesh = bust;
+        TANGENTS::generate(mesh);
+        BENCHMARK::doNotOptimize(mesh.tangents.data());
+    });
+
+    ThreadPool workers;
+    suite.add("tangents/generate (threads)", [&]() {
+        Mesh mesh = bust;
+        TANGENTS::generate(mesh, &workers);
+        BENCHMARK::doNotOptimize(mesh.tangents.data());
+    });
+
+    // Optimizing the model, on a fresh copy every iteration since the passes work in place
+    suite.add("meshopt/optimize", [&]() {
+        Mesh mesh = bust;
+        MESHOPT::optimize(mesh);
+        BENCHMARK::doNotOptimize(mesh.indices.data());
+    });
+
+    suite.add("meshopt/generateLODs", [&]() {
+        Mesh mesh = bust;
+        MESHOPT::generateLODs(mesh);
+        BENCHMARK::doNotOptimize(mesh.lods.data());
+    });
+
+    suite.add("meshopt/buildMeshlets", [&]() {
+        std::vector<Meshlet> meshlets = MESHOPT::buildMeshlets(bust.indices, bust.vertices);
+        BENCHMARK::doNotOptimize(meshlets.data());
+    });
+
+    // A scene graph of 1 + 10 + 10 * 100 nodes
+    SceneNode root;
+    for (int i = 0; i < 10; i++)
+    {
+        SceneNode *group = new SceneNode();
+        group->rotate(0, 36.0f * i, 0);
+        root.addChild(group);
+        for (int j = 0; j < 100; j++)
+        {
+            SceneNode *node = new SceneNode();
+            node->translate((float)j, 0, 0);
+            node->rotate(j, 0, 0);
+            group->addChild(node);
+        }
+    }
+    suite.add("sceneNode/updateTransformations 1011 nodes", [&]() {
+        root.updateTransformations(glm::mat4(1));
+        BENCHMARK::doNotOptimize(root.children.back()->children.back()->M);
+    });
+
+    return suite.run();
+}
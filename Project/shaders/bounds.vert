@@ -0,0 +1,18 @@
+#version 450 core
+
+
+
+// Attributes
+in layout(location = 0) vec3 in_position; // Corner of a unit cube (-1 to 1)
+
+// Uniforms
+uniform layout(location = 2) mat4 V; // View Matrix
+uniform layout(location = 3) mat4 P; // Projection Matrix
+uniform layout(location = 5) mat4 B; // Unit cube to world space bounding box
+
+
+
+void main()
+{
+    gl_Position = P * V * B * vec4(in_position, 1);
+}
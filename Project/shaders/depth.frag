@@ -0,0 +1,8 @@
+#version 450 core
+
+
+
+// Used for the depth pre-pass, only the depth of the fragment is written
+void main()
+{
+}
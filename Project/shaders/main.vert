@@ -1,19 +1,23 @@
-#version 460 core
+#version 450 core
 
 
 
 // Attributes
 in layout(location = 0) vec3 in_position;
 in layout(location = 1) vec3 in_normal;
-in layout(location = 2) vec3 in_tangent;
-in layout(location = 3) vec3 in_bitangent;
+in layout(location = 2) vec4 in_tangent; // w is the handedness of the tangent frame (+1 or -1)
 in layout(location = 4) vec2 in_texture_coordinates;
 
 // Uniforms
-uniform layout(location = 1) mat4 M; // Model Matrix
 uniform layout(location = 2) mat4 V; // View Matrix
 uniform layout(location = 3) mat4 P; // Projection Matrix
-uniform layout(location = 4) mat3 N; // Normal Matrix
+
+// Per object values, streamed every frame
+layout(std140, binding = 0) uniform Object
+{
+    mat4 M; // Model Matrix
+    mat3 N; // Normal Matrix
+};
 
 
 
@@ -23,6 +27,10 @@ out layout(location = 2) vec3 out_normal;
 out layout(location = 3) vec2 out_texture_coordinates;
 out layout(location = 4) mat3 TBN; // Tangent Bitangent Normal Matrix
 
+// The depth pre-pass and the shading pass are different programs, and the shading pass only draws where its depth equals
+// what the pre-pass wrote. Without this the compiler may compute the position differently in each of them
+invariant gl_Position;
+
 
 
 void main()
@@ -34,9 +42,9 @@ void main()
     out_normal              = normalize(N * in_normal);
     out_texture_coordinates = in_texture_coordinates;
 
-    // Construct TBN matrix
-    vec3 tangent   = normalize(N * in_tangent);
-    vec3 bitangent = normalize(N * in_bitangent);
+    // Construct TBN matrix, the bitangent is not stored but follows from the normal, tangent and handedness
+    vec3 tangent   = normalize(N * in_tangent.xyz);
     vec3 normal    = normalize(N * in_normal);
+    vec3 bitangent = cross(normal, tangent) * in_tangent.w;
     TBN            = mat3(tangent, bitangent, normal);
 }
\ No newline at end of file
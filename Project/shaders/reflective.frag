@@ -1,4 +1,4 @@
-#version 460 core
+#version 450 core
 
 
 
@@ -11,10 +11,13 @@ in layout(location = 4) mat3 TBN;
 // Uniforms
 uniform layout(location = 10) bool has_textures;
 uniform layout(location = 11) vec3 camera_position;
+uniform layout(location = 14) ivec3 material_layers; // diffuse, normal, roughness
+uniform layout(location = 15) bool has_environment;
 
 // Textures
 uniform layout(binding = 0) samplerCube skybox;
-uniform layout(binding = 2) sampler2D normal_map;
+uniform layout(binding = 2) sampler2DArray normal_map;
+uniform layout(binding = 4) samplerCube environment;
 
 
 
@@ -23,6 +26,15 @@ out vec4 fragment_color;
 
 
 
+// The node's own environment map if it has one, otherwise the skybox
+vec3 sample_environment(vec3 direction)
+{
+    if (has_environment) return texture(environment, direction).rgb;
+    return texture(skybox, direction).rgb;
+}
+
+
+
 // Reflection from environment
 vec3 get_reflection(vec3 N)
 {
@@ -33,7 +45,7 @@ vec3 get_reflection(vec3 N)
     //    ------------ surface
     vec3 I = normalize(in_position - camera_position);
     vec3 R = reflect(I, N);
-    return texture(skybox, R).rgb;
+    return sample_environment(R).rgb;
 }
 
 
@@ -44,7 +56,7 @@ void main()
 
     if (has_textures)
     {
-        normal = normalize(TBN * (texture(normal_map, in_texture_coordinates).xyz * 2 - 1));
+        normal = normalize(TBN * (texture(normal_map, vec3(in_texture_coordinates, material_layers.y)).xyz * 2 - 1));
     }
 
     fragment_color = vec4(get_reflection(normal), 1);
@@ -1,4 +1,4 @@
-#version 460 core
+#version 450 core
 
 
 
@@ -11,10 +11,13 @@ in layout(location = 4) mat3 TBN;
 // Uniforms
 uniform layout(location = 10) bool has_textures;
 uniform layout(location = 11) vec3 camera_position;
+uniform layout(location = 14) ivec3 material_layers; // diffuse, normal, roughness
+uniform layout(location = 15) bool has_environment;
 
 // Textures
 uniform layout(binding = 0) samplerCube skybox;
-uniform layout(binding = 2) sampler2D normal_map;
+uniform layout(binding = 2) sampler2DArray normal_map;
+uniform layout(binding = 4) samplerCube environment;
 
 // Values
 float refraction_index  = 1.53; // Glass
@@ -27,6 +30,15 @@ out vec4 fragment_color;
 
 
 
+// The node's own environment map if it has one, otherwise the skybox
+vec3 sample_environment(vec3 direction)
+{
+    if (has_environment) return texture(environment, direction).rgb;
+    return texture(skybox, direction).rgb;
+}
+
+
+
 // Fresnel is a combination of refraction and reflection based
 // on the type of material, the way a window is transparent when looking
 // directly at it, but from an angle it works as a mirror.
@@ -48,7 +60,7 @@ vec3 fresnel(vec3 N)
     //    ------------ surface
 
     vec3 Reflect    = reflect(I, N);
-    vec3 reflection = texture(skybox, Reflect).rgb;
+    vec3 reflection = sample_environment(Reflect);
 
     // Calculate Refraction
     //
@@ -60,9 +72,9 @@ vec3 fresnel(vec3 N)
     //           \ Refract
 
     vec3 Refract    = refract(I, N, index_of_refraction);
-    float r         = texture(skybox, Refract + dispersion_factor).r;
-    float g         = texture(skybox, Refract).g;
-    float b         = texture(skybox, Refract - dispersion_factor).b;
+    float r         = sample_environment(Refract + dispersion_factor).r;
+    float g         = sample_environment(Refract).g;
+    float b         = sample_environment(Refract - dispersion_factor).b;
     vec3 refraction = vec3(r, g, b);
 
     // Calculate Fresnel
@@ -87,7 +99,7 @@ void main()
 
     if (has_textures)
     {
-        normal = normalize(TBN * (texture(normal_map, in_texture_coordinates).xyz * 2 - 1));
+        normal = normalize(TBN * (texture(normal_map, vec3(in_texture_coordinates, material_layers.y)).xyz * 2 - 1));
     }
 
     fragment_color = vec4(fresnel(normal), 1.0);
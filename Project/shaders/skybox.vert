@@ -1,4 +1,4 @@
-#version 460 core
+#version 450 core
 
 
 
@@ -18,6 +18,7 @@ out layout(location = 1) vec3 out_fragment_position;
 
 void main()
 {
-    gl_Position           = P * V * vec4(in_position, 1);
+    // z = w puts the skybox at max depth, so it's only drawn where nothing else is
+    gl_Position           = (P * V * vec4(in_position, 1)).xyww;
     out_fragment_position = in_position;
 }
\ No newline at end of file
@@ -1,4 +1,4 @@
-#version 460 core
+#version 450 core
 
 // From Vertex Shader
 in layout(location = 1) vec3 in_fragment_position;
@@ -11,11 +11,12 @@ uniform layout(location = 10) bool has_textures;
 uniform layout(location = 11) vec3 camera_position;
 uniform layout(location = 12) vec3 sunlight_color;
 uniform layout(location = 13) vec3 sunlight_direction;
+uniform layout(location = 14) ivec3 material_layers; // diffuse, normal, roughness
 
 // Textures
-uniform layout(binding = 1) sampler2D diffuse_map;
-uniform layout(binding = 2) sampler2D normal_map;
-uniform layout(binding = 3) sampler2D roughness_map;
+uniform layout(binding = 1) sampler2DArray diffuse_map;
+uniform layout(binding = 2) sampler2DArray normal_map;
+uniform layout(binding = 3) sampler2DArray roughness_map;
 
 
 
@@ -47,9 +48,9 @@ void main()
 
     if (has_textures)
     {
-        normal    = normalize(TBN * (texture(normal_map, in_texture_coordinates).xyz * 2 - 1));
-        color     = texture(diffuse_map, in_texture_coordinates).rgb;
-        roughness = texture(roughness_map, in_texture_coordinates).x;
+        normal    = normalize(TBN * (texture(normal_map, vec3(in_texture_coordinates, material_layers.y)).xyz * 2 - 1));
+        color     = texture(diffuse_map, vec3(in_texture_coordinates, material_layers.x)).rgb;
+        roughness = texture(roughness_map, vec3(in_texture_coordinates, material_layers.z)).x;
     }
 
     fragment_color = vec4(color * sunlight(normal, roughness), 1);
@@ -0,0 +1,183 @@
+#ifndef ASSET_LOADER_HPP
+#define ASSET_LOADER_HPP
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utilities/trace.hpp"
+
+
+
+/**
+ * Loads assets in the background, so the window can show the scene while its files are still being read.
+ *
+ * Loading an asset is split in two: reading and decoding the file runs on one of the loader threads, and the part that
+ * needs the OpenGL context (which only the main thread has) is queued until the main thread calls uploadReady() between
+ * frames. Until then the asset is whatever placeholder the caller made for it.
+ *
+ *      loader.load<Image>("diffuse.png", [=]() { return Image(file); },
+ *                         [=](Image &image) { texture->replace(image); });
+ */
+class AssetLoader
+{
+public:
+    /** @param threads Number of loader threads, 0 for one per core */
+    AssetLoader(unsigned int threads = 0)
+    {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threads; i++) loaders.push_back(std::thread(&AssetLoader::run, this, i));
+    }
+
+    /** Assets that are still loading are dropped, the loader threads finish the one they are reading first */
+    ~AssetLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &loader : loaders) loader.join();
+    }
+
+    /**
+     * @brief Calls read() on a loader thread, and upload() with what it returned on the main thread when it is done
+     *
+     * @param name What is loaded, shown in the trace
+     * @param read Reads the asset, must not use OpenGL or anything the main thread changes
+     * @param upload Hands the asset over to where it is used, in uploadReady()
+     */
+    template <class T>
+    void load(std::string const &name, std::function<T()> read, std::function<void(T &)> upload)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back({ name, [read, upload]() {
+                                    std::shared_ptr<T> asset = std::make_shared<T>(read());
+                                    return std::function<void()>([asset, upload]() { upload(*asset); });
+                                } });
+            unfinished++;
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * @brief Uploads the assets that are done reading, until the budget is spent. At least one is uploaded if there are
+     * any, so loading keeps going however big the assets are. Call from the main thread.
+     *
+     * @param budget Milliseconds to spend, an upload that is started is always finished
+     * @return Number of assets uploaded
+     */
+    int uploadReady(double budget)
+    {
+        auto start   = std::chrono::steady_clock::now();
+        int uploaded = 0;
+        while (true)
+        {
+            Upload next;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (uploads.empty() || (0 < uploaded && budget <= elapsed)) break;
+                next = std::move(uploads.front());
+                uploads.pop_front();
+            }
+            {
+                TRACE::Scope scope("upload " + next.name, "loading");
+                next.upload();
+            }
+            uploaded++;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            unfinished--;
+        }
+        return uploaded;
+    }
+
+    /** @brief Waits for every asset requested so far, and uploads them. For when the scene has to be complete right away */
+    void finish()
+    {
+        TRACE::Scope scope("finish loading", "loading");
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&]() { return unfinished == 0 || !uploads.empty(); });
+                if (unfinished == 0) return;
+            }
+            uploadReady(std::numeric_limits<double>::infinity());
+        }
+    }
+
+    /** @brief Whether any requested asset is not uploaded yet */
+    bool isLoading()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return unfinished != 0;
+    }
+
+
+
+private:
+    // Disable copying and assignment
+    AssetLoader(AssetLoader const &) = delete;
+    AssetLoader &operator=(AssetLoader const &) = delete;
+
+    struct Request
+    {
+        std::string name;
+        std::function<std::function<void()>()> read; // returns the upload
+    };
+
+    struct Upload
+    {
+        std::string name;
+        std::function<void()> upload;
+    };
+
+    std::vector<std::thread> loaders;
+    std::mutex mutex;
+    std::condition_variable wake;  // a request was added
+    std::condition_variable ready; // an upload was added
+    bool stopping = false;
+
+    std::deque<Request> requests; // in the order they were made, so what is needed first is read first
+    std::deque<Upload> uploads;
+    size_t unfinished = 0; // requested but not uploaded yet
+
+    void run(unsigned int index)
+    {
+        TRACE::setThreadName("loader " + std::to_string(index));
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&]() { return stopping || !requests.empty(); });
+            if (stopping) return;
+            Request request = std::move(requests.front());
+            requests.pop_front();
+
+            lock.unlock();
+            Upload upload;
+            upload.name = request.name;
+            {
+                TRACE::Scope scope("load " + request.name, "loading");
+                upload.upload = request.read();
+            }
+            lock.lock();
+
+            uploads.push_back(std::move(upload));
+            ready.notify_all();
+        }
+    }
+};
+
+#endif
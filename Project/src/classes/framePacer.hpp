@@ -0,0 +1,222 @@
+#ifndef FRAME_PACER_HPP
+#define FRAME_PACER_HPP
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "options.hpp"
+
+
+
+// Summary of the recorded frame intervals, all times in milliseconds
+struct FrameStatistics
+{
+    unsigned long frames = 0;
+    double mean          = 0;
+    double p50           = 0;
+    double p95           = 0;
+    double p99           = 0;
+    double max           = 0;
+    double jitter        = 0; // standard deviation of the frame intervals
+};
+
+
+
+/**
+ * Histogram of frame intervals with fixed size bins, so recording a frame never allocates.
+ * Intervals longer than the last bin are counted in the last bin, but the exact maximum is kept separately.
+ */
+class FrameHistogram
+{
+public:
+    /**
+     * @param binWidth Width of each bin in milliseconds
+     * @param maxInterval Longest interval in milliseconds with its own bin
+     */
+    FrameHistogram(double binWidth = 0.05, double maxInterval = 250.0)
+    {
+        this->binWidth = binWidth;
+        bins.resize((size_t)std::ceil(maxInterval / binWidth) + 1, 0);
+    }
+
+    void record(double milliseconds)
+    {
+        size_t bin = std::min(bins.size() - 1, (size_t)std::max(0.0, milliseconds / binWidth));
+        bins[bin]++;
+        count++;
+        sum += milliseconds;
+        sumSquared += milliseconds * milliseconds;
+        max = std::max(max, milliseconds);
+    }
+
+    /** Interval in milliseconds that the given fraction (0 to 1) of frames are at or below */
+    double percentile(double fraction)
+    {
+        if (count == 0) return 0;
+        unsigned long rank  = (unsigned long)std::ceil(fraction * count);
+        unsigned long below = 0;
+        for (size_t bin = 0; bin < bins.size(); bin++)
+        {
+            below += bins[bin];
+            if (rank <= below) return std::min(max, (bin + 1) * binWidth);
+        }
+        return max;
+    }
+
+    FrameStatistics getStatistics()
+    {
+        FrameStatistics statistics;
+        if (count == 0) return statistics;
+        statistics.frames = count;
+        statistics.mean   = sum / count;
+        statistics.p50    = percentile(0.50);
+        statistics.p95    = percentile(0.95);
+        statistics.p99    = percentile(0.99);
+        statistics.max    = max;
+        statistics.jitter = std::sqrt(std::max(0.0, sumSquared / count - statistics.mean * statistics.mean));
+        return statistics;
+    }
+
+    void reset()
+    {
+        std::fill(bins.begin(), bins.end(), 0);
+        count      = 0;
+        sum        = 0;
+        sumSquared = 0;
+        max        = 0;
+    }
+
+
+
+private:
+    std::vector<unsigned long> bins;
+    double binWidth;
+    unsigned long count = 0;
+    double sum          = 0;
+    double sumSquared   = 0;
+    double max          = 0;
+};
+
+
+
+/**
+ * Keeps the time between frames as even as possible.
+ *
+ * Every frame has an absolute deadline, one target interval after the previous one, so an early or late frame does not
+ * shift the frames after it. The wait is done in two steps: sleep until shortly before the deadline (the OS may wake us
+ * up late, so the sleep is kept short of it), and then spin for the rest, which is accurate to a few microseconds.
+ *
+ * In adaptive mode the time spent working on each frame is measured, and if the scene can not keep up with the target
+ * the interval is stretched to a whole multiple of it, since a steady 30 fps looks better than something between 30
+ * and 60.
+ */
+class FramePacer
+{
+    typedef std::chrono::steady_clock Clock;
+
+public:
+    /**
+     * @param mode How to pace the frames
+     * @param targetFPS The wanted frame rate, ignored in unlimited mode
+     */
+    FramePacer(PacingMode mode, double targetFPS)
+    {
+        this->mode     = mode;
+        targetInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFPS));
+        interval       = targetInterval;
+        previousFrame  = Clock::now();
+        deadline       = previousFrame + interval;
+    }
+
+    /**
+     * @brief Waits until it is time to start the next frame (if pacing is enabled) and records the frame interval
+     *
+     * @return Time in seconds since the previous call
+     */
+    float nextFrame()
+    {
+        Clock::time_point workDone = Clock::now();
+        if (mode == ADAPTIVE) adapt(workDone - previousFrame);
+
+        if (mode != UNLIMITED)
+        {
+            waitUntil(deadline);
+            deadline += interval;
+            // If we fell more than a frame behind, start over instead of rushing frames to catch up
+            if (deadline < Clock::now()) deadline = Clock::now() + interval;
+        }
+
+        Clock::time_point now = Clock::now();
+        double seconds        = std::chrono::duration<double>(now - previousFrame).count();
+        previousFrame         = now;
+        histogram.record(seconds * 1000.0);
+        return (float)seconds;
+    }
+
+    FrameStatistics getStatistics()
+    {
+        return histogram.getStatistics();
+    }
+
+    void resetStatistics()
+    {
+        histogram.reset();
+    }
+
+    /** Current time between frames in milliseconds, differs from the target in adaptive mode */
+    double getIntervalMilliseconds()
+    {
+        return std::chrono::duration<double, std::milli>(interval).count();
+    }
+
+    void printStatistics()
+    {
+        FrameStatistics s = getStatistics();
+        printf("Frame times (%lu frames, target %.2f ms): mean %.2f ms, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms, jitter %.3f ms\n",
+               s.frames, getIntervalMilliseconds(), s.mean, s.p50, s.p95, s.p99, s.max, s.jitter);
+    }
+
+
+
+private:
+    // Sleeping is only precise to about a millisecond (more on some systems), so the last part is spun
+    const Clock::duration spinTime = std::chrono::microseconds(2000);
+    // Number of frames between each time the adaptive interval is reconsidered
+    const size_t adaptWindow = 60;
+
+    PacingMode mode;
+    Clock::duration targetInterval;
+    Clock::duration interval;
+    Clock::time_point previousFrame;
+    Clock::time_point deadline;
+    FrameHistogram histogram;
+    std::vector<Clock::duration> workTimes;
+
+    void waitUntil(Clock::time_point time)
+    {
+        if (Clock::now() + spinTime < time) std::this_thread::sleep_until(time - spinTime);
+        while (Clock::now() < time) std::this_thread::yield();
+    }
+
+    /** Pick the shortest whole multiple of the target interval that the recent frames fit within (using the 95th percentile) */
+    void adapt(Clock::duration workTime)
+    {
+        workTimes.push_back(workTime);
+        if (workTimes.size() < adaptWindow) return;
+
+        std::nth_element(workTimes.begin(), workTimes.begin() + workTimes.size() * 95 / 100, workTimes.end());
+        Clock::duration slowest = workTimes[workTimes.size() * 95 / 100];
+        workTimes.clear();
+
+        // Leave 10% headroom so that small variations do not make us miss a deadline
+        double ratio = 1.1 * slowest.count() / (double)targetInterval.count();
+        interval     = targetInterval * std::max(1L, (long)std::ceil(ratio));
+    }
+};
+
+#endif
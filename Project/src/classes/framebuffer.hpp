@@ -2,11 +2,14 @@
 #define FRAMEBUFFER_HPP
 #pragma once
 
+#include <cassert>
 #include <string>
 #include <vector>
 
 #include <glm/glm.hpp>
 
+#include "utilities/glState.hpp"
+
 
 
 /**
@@ -30,86 +33,101 @@ public:
     Framebuffer(unsigned int size)
     {
         // Create the framebuffer
-        glGenFramebuffers(1, &ID);
+        glCreateFramebuffers(1, &ID);
 
         // Create the cubemap texture the framebuffer will render to
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-        for (unsigned int i = 0; i < 6; i++)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-        }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+        glTextureStorage2D(textureID, 1, GL_RGB8, size, size);
+        glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
         // Create the depth render buffer
-        glGenRenderbuffers(1, &depthID);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthID);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, size, size);
+        glCreateRenderbuffers(1, &depthID);
+        glNamedRenderbufferStorage(depthID, GL_DEPTH_COMPONENT, size, size);
 
-        // Bind parts togther
-        glBindFramebuffer(GL_FRAMEBUFFER, ID); // activate this framebuffer, and attach texture and depth buffer to it
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, textureID, 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ID);
+        // Attach texture and depth buffer to the framebuffer (without having to bind anything)
+        glNamedFramebufferTextureLayer(ID, GL_COLOR_ATTACHMENT0, textureID, 0, 0);
+        glNamedFramebufferRenderbuffer(ID, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthID);
 
         checkFramebufferStatus("Creating Cubemap Framebuffer Failed");
-        Framebuffer::activateScreen(); // Revert to screen framebuffer after creation
         this->width  = size;
         this->height = size;
     }
 
     /**
-     * @brief Single Texture Framebuffer
+     * @brief Single Texture Framebuffer, used in place of the window when running headless
      */
-    [[deprecated("was supposed to be used for back-side refraction, but didnt have time to fully implement it")]]
-
     Framebuffer(unsigned int width, unsigned int height)
     {
         // Create the framebuffer
-        glGenFramebuffers(1, &ID);
+        glCreateFramebuffers(1, &ID);
 
-        // Create the cubemap texture the framebuffer will render to
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // Create the texture the framebuffer will render to
+        glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+        glTextureStorage2D(textureID, 1, GL_RGB8, width, height);
+        glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
         // Create the depth render buffer
-        glGenRenderbuffers(1, &depthID);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthID);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+        glCreateRenderbuffers(1, &depthID);
+        glNamedRenderbufferStorage(depthID, GL_DEPTH_COMPONENT, width, height);
 
-        // Bind parts togther
-        glBindFramebuffer(GL_FRAMEBUFFER, ID); // activate this framebuffer, and attach texture and depth buffer to it
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureID, 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ID);
+        // Attach texture and depth buffer to the framebuffer
+        glNamedFramebufferTexture(ID, GL_COLOR_ATTACHMENT0, textureID, 0);
+        glNamedFramebufferRenderbuffer(ID, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthID);
 
         checkFramebufferStatus("Creating Framebuffer Failed");
-        Framebuffer::activateScreen(); // Revert to screen framebuffer after creation
         this->width  = width;
         this->height = height;
     }
 
 
 
-    // Render to this framebuffer
+    // Render to this framebuffer, clearing is left to selectRenderTargetSide() as each side is cleared anyway
     void activate()
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, ID);              // activate this framebuffer
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the buffers
-        glViewport(0, 0, width, height);                    // update viewport
+        GLSTATE::bindFramebuffer(ID);           // activate this framebuffer
+        GLSTATE::viewport(0, 0, width, height); // update viewport
     }
 
-    // Render to default (screen) framebuffer
+    // Render to default (screen) framebuffer, or the offscreen one when running headless
     static void activateScreen()
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);               // unbind framebuffer
+        Framebuffer *offscreen = getOffscreen();
+        GLSTATE::bindFramebuffer(offscreen ? offscreen->ID : 0);
+        GLSTATE::viewport(0, 0, getScreenWidth(), getScreenHeight());
+        GLSTATE::depthMask(GL_TRUE);                        // depth is only cleared when writing is enabled
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the buffers
-        glViewport(0, 0, WINDOW::width, WINDOW::height);
+    }
+
+    // Use the given framebuffer instead of the window as the screen (nullptr to go back to the window)
+    static void setOffscreen(Framebuffer *framebuffer)
+    {
+        offscreen() = framebuffer;
+    }
+
+    static Framebuffer *getOffscreen()
+    {
+        return offscreen();
+    }
+
+    // Size (in pixels) of the window's framebuffer, which is the screen when there is no offscreen framebuffer
+    static void setWindowSize(int width, int height)
+    {
+        windowSize() = glm::ivec2(width, height);
+    }
+
+    static int getScreenWidth()
+    {
+        return offscreen() ? offscreen()->width : windowSize().x;
+    }
+
+    static int getScreenHeight()
+    {
+        return offscreen() ? offscreen()->height : windowSize().y;
     }
 
     // draw to the given cubemap textures side:
@@ -125,17 +143,30 @@ public:
     void selectRenderTargetSide(unsigned int side)
     {
         // we have to update to the correct cubemap texture, otherwise they would all render to the same side (right)
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + side, textureID, 0);
+        glNamedFramebufferTextureLayer(ID, GL_COLOR_ATTACHMENT0, textureID, 0, side);
         // Clear this side of the cubemap before rendering
+        GLSTATE::depthMask(GL_TRUE);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     }
 
 
 private:
+    static Framebuffer *&offscreen()
+    {
+        static Framebuffer *framebuffer = nullptr;
+        return framebuffer;
+    }
+
+    static glm::ivec2 &windowSize()
+    {
+        static glm::ivec2 size = glm::ivec2(0);
+        return size;
+    }
+
     // Verify that the state of the framebuffer is correct, prints error if it isnt.
     void checkFramebufferStatus(std::string errorMessage)
     {
-        auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        auto status = glCheckNamedFramebufferStatus(ID, GL_FRAMEBUFFER);
         if (status == GL_FRAMEBUFFER_COMPLETE) return;
 
         fprintf(stderr, "\nError: %s\t%d", errorMessage.c_str(), (int)status);
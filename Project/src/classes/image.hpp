@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "options.hpp"
+#include "utilities/trace.hpp"
 #include "utilities/wrappers.hpp"
 
 
@@ -37,6 +38,7 @@ public:
      */
     Image(const std::string &filename)
     {
+        TRACE::Scope scope("decode " + filename, "loading");
         int channels;
         unsigned char *data = STB::load(filename.c_str(), &width, &height, &channels, 4);
         if (!data)
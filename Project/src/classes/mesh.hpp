@@ -2,7 +2,9 @@
 #define MESH_HPP
 #pragma once
 
+#include <cstring>
 #include <fstream>
+#include <unordered_map>
 #include <vector>
 
 #include <cgltf.h>
@@ -14,6 +16,7 @@
 #include <glm/glm.hpp>
 
 #include "options.hpp"
+#include "utilities/trace.hpp"
 
 
 enum SurfaceType
@@ -24,6 +27,75 @@ enum SurfaceType
 };
 
 
+// Axis aligned bounding box
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(0);
+    glm::vec3 max = glm::vec3(0);
+
+    glm::vec3 center() { return (min + max) * 0.5f; }
+    glm::vec3 size() { return max - min; }
+};
+
+
+// Everything that makes a vertex unique, compared bit by bit (used when welding)
+struct WeldKey
+{
+    float values[8];
+
+    WeldKey(glm::vec3 position, glm::vec3 normal, glm::vec2 uv)
+    {
+        float data[8] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y };
+        // Adding 0 turns -0 into +0, so the two compare equal bit by bit
+        for (int i = 0; i < 8; i++) values[i] = data[i] + 0.0f;
+    }
+
+    bool operator==(WeldKey const &other) const
+    {
+        return memcmp(values, other.values, sizeof(values)) == 0;
+    }
+};
+
+struct WeldKeyHash
+{
+    size_t operator()(WeldKey const &key) const
+    {
+        // FNV-1a over the bytes
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(key.values);
+        size_t hash                = 14695981039346656037ULL;
+        for (size_t i = 0; i < sizeof(key.values); i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        return hash;
+    }
+};
+
+
+// A small cluster of consecutive triangles that can be culled on its own (see MESHOPT::buildMeshlets)
+struct Meshlet
+{
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+
+    // Bounding sphere, in model space
+    glm::vec3 center = glm::vec3(0);
+    float radius     = 0;
+
+    // Every triangle faces away from an eye where dot(center - eye, coneAxis) >= coneCutoff * distance + radius
+    glm::vec3 coneAxis = glm::vec3(0);
+    float coneCutoff   = 1; // 1 when the triangles face too many ways for the test to ever pass
+
+    // Added to the indices when drawing, set when the index buffer is split into chunks (see SceneNode::generateBuffer)
+    int baseVertex = 0;
+};
+
+// A simplified version of a mesh's triangles, using the same vertices (see MESHOPT::generateLODs)
+struct LevelOfDetail
+{
+    std::vector<unsigned int> indices;
+    float error = 0; // how far (in model space) the simplified surface may be from the original
+    std::vector<Meshlet> meshlets;
+};
+
+
 struct Mesh
 {
 public:
@@ -31,12 +103,22 @@ public:
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec2> textureCoordinates;
+    std::vector<glm::vec4> tangents; // w is the handedness, from the file or TANGENTS::generate
+    std::vector<LevelOfDetail> lods; // from fine to coarse, not including the full mesh
+    std::vector<Meshlet> meshlets;   // of the full mesh, empty until built
 
 
     Mesh() = default;
 
+    /** @brief A mesh of a single primitive of a glTF file (see SceneNode::fromGLTF) */
+    Mesh(cgltf_primitive const &primitive)
+    {
+        addPrimitive(primitive);
+    }
+
     Mesh(std::string const &filename, std::string const &root = "../res/models/")
     {
+        TRACE::Scope scope("load glTF " + filename, "loading");
         std::string file = root + filename;
         cgltf_data *data = readData(file.c_str());
         loadData(data);
@@ -46,6 +128,72 @@ public:
 
 
 
+    /** Smallest box containing all vertices of the mesh */
+    Bounds getBounds()
+    {
+        Bounds bounds;
+        if (vertices.empty()) return bounds;
+        bounds.min = bounds.max = vertices[0];
+        for (glm::vec3 &vertex : vertices)
+        {
+            bounds.min = glm::min(bounds.min, vertex);
+            bounds.max = glm::max(bounds.max, vertex);
+        }
+        return bounds;
+    }
+
+
+
+    /**
+     * @brief Merges vertices with the exact same position, normal and texture coordinates, and points the indices at the
+     * merged ones. The shapes are built from separate triangles, so nothing is shared until this is done (a sphere goes
+     * from 6 vertices per patch to about 1). Triangles that end up with two identical corners (at the poles) are dropped.
+     */
+    void weld()
+    {
+        bool hasNormals  = normals.size() == vertices.size();
+        bool hasUVs      = textureCoordinates.size() == vertices.size();
+        bool hasTangents = tangents.size() == vertices.size();
+
+        std::unordered_map<WeldKey, unsigned int, WeldKeyHash> unique;
+        unique.reserve(vertices.size());
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<glm::vec3> weldedVertices, weldedNormals;
+        std::vector<glm::vec2> weldedUVs;
+        std::vector<glm::vec4> weldedTangents;
+
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            glm::vec3 normal = hasNormals ? normals[i] : glm::vec3(0);
+            glm::vec2 uv     = hasUVs ? textureCoordinates[i] : glm::vec2(0);
+            auto inserted    = unique.emplace(WeldKey(vertices[i], normal, uv), (unsigned int)weldedVertices.size());
+            remap[i]         = inserted.first->second;
+            if (!inserted.second) continue;
+
+            weldedVertices.push_back(vertices[i]);
+            if (hasNormals) weldedNormals.push_back(normal);
+            if (hasUVs) weldedUVs.push_back(uv);
+            if (hasTangents) weldedTangents.push_back(tangents[i]); // the first one, they come from the same surface
+        }
+
+        std::vector<unsigned int> weldedIndices;
+        weldedIndices.reserve(indices.size());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a == b || b == c || c == a) continue;
+            weldedIndices.insert(weldedIndices.end(), { a, b, c });
+        }
+
+        vertices.swap(weldedVertices);
+        indices.swap(weldedIndices);
+        if (hasNormals) normals.swap(weldedNormals);
+        if (hasUVs) textureCoordinates.swap(weldedUVs);
+        if (hasTangents) tangents.swap(weldedTangents);
+    }
+
+
+
     void addVertex(glm::vec3 vertex)
     {
         vertices.push_back(vertex);
@@ -106,8 +254,56 @@ public:
 
 
 
-private: // Helper methods to load mesh from a .gltf file
-    cgltf_data *readData(const char *file)
+    /**
+     * @brief Appends the triangles of a glTF primitive, with its indices moved past the vertices already in the mesh.
+     * Primitives that are not triangles are skipped.
+     */
+    void addPrimitive(cgltf_primitive const &primitive)
+    {
+        if (primitive.type != cgltf_primitive_type_triangles) return;
+        size_t firstVertex = vertices.size();
+        size_t firstIndex  = indices.size();
+
+        // An attribute the earlier primitives did not have starts with zeros for their vertices, so it stays per vertex
+        bool hasNormals = false;
+        for (cgltf_size attributeIndex = 0; attributeIndex < primitive.attributes_count; attributeIndex++)
+        {
+            cgltf_attribute &attribute = primitive.attributes[attributeIndex];
+            if (attribute.type == cgltf_attribute_type_normal)
+            {
+                normals.resize(firstVertex);
+                hasNormals = true;
+            }
+            if (attribute.type == cgltf_attribute_type_texcoord && attribute.index == 0) textureCoordinates.resize(firstVertex);
+            if (attribute.type == cgltf_attribute_type_tangent) tangents.resize(firstVertex);
+            addAttribute(attribute);
+        }
+
+        // Without indices every three vertices are a triangle
+        if (primitive.indices != nullptr)
+        {
+            readIndices(*primitive.indices);
+            for (size_t i = firstIndex; i < indices.size(); i++) indices[i] += (unsigned int)firstVertex;
+        }
+        else
+        {
+            for (size_t v = firstVertex; v < vertices.size(); v++) indices.push_back((unsigned int)v);
+        }
+
+        // And one this primitive does not have gets zeros for its vertices. Tangents are left like that, a zero w marks
+        // them for TANGENTS::generate, but normals are needed for lighting so they are made from the triangles here
+        if (!textureCoordinates.empty()) textureCoordinates.resize(vertices.size());
+        if (!tangents.empty()) tangents.resize(vertices.size());
+        if (hasNormals)
+            normals.resize(vertices.size());
+        else
+            addTriangleNormals(firstVertex, firstIndex);
+    }
+
+
+
+    /** @brief Parses a glTF file and loads its buffers, nullptr if that failed. Free it with cgltf_free */
+    static cgltf_data *readData(const char *file)
     {
         std::ifstream fd(file);
         if (fd.fail())
@@ -146,93 +342,138 @@ private: // Helper methods to load mesh from a .gltf file
         return data;
     }
 
+
+
+private: // Helper methods to load mesh from a .gltf file
+    /**
+     * @brief Appends every value of the accessor. Tightly packed floats (what exporters write for positions, normals
+     * etc.) are copied straight out of the loaded .bin buffer in one go, anything else (normalized integers, strides,
+     * sparse accessors) is unpacked by cgltf, still in one call.
+     */
+    template <class T>
+    static void readFloats(cgltf_accessor const &accessor, std::vector<T> &values)
+    {
+        const cgltf_size components = sizeof(T) / sizeof(float);
+        if (cgltf_num_components(accessor.type) != components) return;
+
+        size_t first = values.size();
+        values.resize(first + accessor.count);
+        float *destination = reinterpret_cast<float *>(values.data() + first);
+
+        const uint8_t *data = accessor.buffer_view ? cgltf_buffer_view_data(accessor.buffer_view) : nullptr;
+        bool packed         = data && !accessor.is_sparse && accessor.component_type == cgltf_component_type_r_32f && accessor.stride == sizeof(T);
+        if (packed)
+            memcpy(destination, data + accessor.offset, accessor.count * sizeof(T));
+        else
+            cgltf_accessor_unpack_floats(&accessor, destination, accessor.count * components);
+    }
+
+    /**
+     * @brief Normals for the vertices from firstVertex on, from the triangles from firstIndex on, each weighted by its
+     * area. Flat for primitives without indices (which glTF asks for), smooth where triangles share vertices.
+     */
+    void addTriangleNormals(size_t firstVertex, size_t firstIndex)
+    {
+        normals.resize(vertices.size(), glm::vec3(0));
+        for (size_t i = firstIndex; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            glm::vec3 normal = glm::cross(vertices[b] - vertices[a], vertices[c] - vertices[a]); // length is twice the area
+            normals[a] += normal;
+            normals[b] += normal;
+            normals[c] += normal;
+        }
+        for (size_t v = firstVertex; v < normals.size(); v++)
+        {
+            float length = glm::length(normals[v]);
+            normals[v]   = 0 < length ? normals[v] / length : glm::vec3(0, 1, 0);
+        }
+    }
+
+    void readIndices(cgltf_accessor const &accessor)
+    {
+        size_t first = indices.size();
+        indices.resize(first + accessor.count);
+        if (cgltf_accessor_unpack_indices(&accessor, indices.data() + first, sizeof(unsigned int), accessor.count) == accessor.count) return;
+
+        // Sparse index accessors (which nobody writes) are read one by one
+        for (cgltf_size i = 0; i < accessor.count; i++) indices[first + i] = (unsigned int)cgltf_accessor_read_index(&accessor, i);
+    }
+
     void addAttribute(cgltf_attribute &attribute)
     {
-        // Get the accessor of the attribute and its component count
         cgltf_accessor &accessor = *attribute.data;
-        unsigned int vecSize     = 0;
-        if (accessor.type == cgltf_type_vec2) vecSize = 2;
-        if (accessor.type == cgltf_type_vec3) vecSize = 3;
-        if (accessor.type == cgltf_type_vec4) vecSize = 4;
-
-        // Read the floats from the accessor
-        std::vector<float> attributeFloats;
-        attributeFloats.resize(vecSize * accessor.count);
-        for (cgltf_size i = 0; i < accessor.count; ++i)
+        switch (attribute.type)
         {
-            cgltf_accessor_read_float(&accessor, i, &attributeFloats[i * vecSize], vecSize);
+            case cgltf_attribute_type_position:
+                readFloats(accessor, vertices);
+                break;
+            case cgltf_attribute_type_texcoord:
+                // Only the first set of texture coordinates is used
+                if (attribute.index == 0) readFloats(accessor, textureCoordinates);
+                break;
+            case cgltf_attribute_type_normal:
+            {
+                size_t first = normals.size();
+                readFloats(accessor, normals);
+                for (size_t i = first; i < normals.size(); i++) normals[i] = glm::normalize(normals[i]);
+            }
+            break;
+            case cgltf_attribute_type_tangent:
+                // With the handedness in w
+                readFloats(accessor, tangents);
+                break;
+            default:
+                break;
         }
+    }
 
-        // Loop over all the values of the accessor
-        // Note that accessor.count is not equal to the number of floats in the accessor
-        // It's equal to the number of attribute values (e.g, vec2s, vec3s, vec4s, etc.) in the accessor
-        cgltf_attribute_type attributeType = attribute.type;
-        unsigned int numAttributeValues    = static_cast<unsigned int>(accessor.count);
-        for (unsigned int attributeValueIndex = 0; attributeValueIndex < numAttributeValues; ++attributeValueIndex)
+    /** @brief Reserves exactly what the primitives of the file's meshes will add, so nothing is reallocated while reading */
+    void reserve(cgltf_data *data)
+    {
+        size_t indexCount = 0, vertexCount = 0, normalCount = 0, uvCount = 0, tangentCount = 0;
+        for (cgltf_size nodeIndex = 0; nodeIndex < data->nodes_count; nodeIndex++)
         {
-            int indexOfFirstFloatOfCurrAttribValue = attributeValueIndex * vecSize;
-            switch (attributeType)
+            cgltf_mesh *mesh = data->nodes[nodeIndex].mesh;
+            if (mesh == nullptr) continue;
+            for (cgltf_size primitiveIndex = 0; primitiveIndex < mesh->primitives_count; primitiveIndex++)
             {
-                case cgltf_attribute_type_position:
-                    // Store a position vec3
-                    vertices.push_back(glm::vec3(attributeFloats[indexOfFirstFloatOfCurrAttribValue + 0],
-                                                 attributeFloats[indexOfFirstFloatOfCurrAttribValue + 1],
-                                                 attributeFloats[indexOfFirstFloatOfCurrAttribValue + 2]));
-                    break;
-                case cgltf_attribute_type_texcoord:
-                    // Store a texture coordinates vec2
-                    textureCoordinates.push_back(glm::vec2(attributeFloats[indexOfFirstFloatOfCurrAttribValue + 0],
-                                                           attributeFloats[indexOfFirstFloatOfCurrAttribValue + 1]));
-                    break;
-                case cgltf_attribute_type_normal:
+                cgltf_primitive &primitive = mesh->primitives[primitiveIndex];
+                if (primitive.indices) indexCount += primitive.indices->count;
+                for (cgltf_size attributeIndex = 0; attributeIndex < primitive.attributes_count; attributeIndex++)
                 {
-                    // Store a normal vec3
-                    glm::vec3 normal = glm::vec3(attributeFloats[indexOfFirstFloatOfCurrAttribValue + 0],
-                                                 attributeFloats[indexOfFirstFloatOfCurrAttribValue + 1],
-                                                 attributeFloats[indexOfFirstFloatOfCurrAttribValue + 2]);
-                    normals.push_back(glm::normalize(normal));
+                    cgltf_attribute &attribute = primitive.attributes[attributeIndex];
+                    if (attribute.type == cgltf_attribute_type_position) vertexCount += attribute.data->count;
+                    if (attribute.type == cgltf_attribute_type_normal) normalCount += attribute.data->count;
+                    if (attribute.type == cgltf_attribute_type_texcoord && attribute.index == 0) uvCount += attribute.data->count;
+                    if (attribute.type == cgltf_attribute_type_tangent) tangentCount += attribute.data->count;
                 }
-                break;
             }
         }
+        indices.reserve(indices.size() + indexCount);
+        vertices.reserve(vertices.size() + vertexCount);
+        normals.reserve(normals.size() + normalCount);
+        textureCoordinates.reserve(textureCoordinates.size() + uvCount);
+        tangents.reserve(tangents.size() + tangentCount);
     }
 
+    /**
+     * @brief Appends every primitive of every node with a mesh. The node transformations are left out, so a file with a
+     * single model comes out in the model's own space (SceneNode::fromGLTF keeps the nodes and their transformations).
+     */
     void loadData(cgltf_data *data)
     {
-        // Loop over the array of nodes of the glTF file
-        unsigned int numNodes = static_cast<unsigned int>(data->nodes_count);
-        for (int nodeIndex = 0; nodeIndex < numNodes; nodeIndex++)
+        if (data == nullptr) return;
+        reserve(data);
+
+        for (cgltf_size nodeIndex = 0; nodeIndex < data->nodes_count; nodeIndex++)
         {
-            // This function only loads static meshes, so the node must contain a mesh for us to process it
-            cgltf_node *model = &data->nodes[nodeIndex];
-            if (model->mesh == nullptr) return;
+            cgltf_mesh *mesh = data->nodes[nodeIndex].mesh;
+            if (mesh == nullptr) continue; // cameras, lights and empty nodes that only group others
 
-            // Loop over the array of mesh primitives of the node
-            unsigned int numPrimitives = static_cast<unsigned int>(model->mesh->primitives_count);
-            for (unsigned int primitiveIndex = 0; primitiveIndex < numPrimitives; ++primitiveIndex)
+            for (cgltf_size primitiveIndex = 0; primitiveIndex < mesh->primitives_count; primitiveIndex++)
             {
-                // Get the current mesh primitive
-                cgltf_primitive *primitive = &model->mesh->primitives[primitiveIndex];
-
-                // If the current mesh primitive has a set of indices, store them
-                if (primitive->indices != nullptr)
-                {
-                    unsigned int indexCount = static_cast<unsigned int>(primitive->indices->count);
-                    for (unsigned int i = 0; i < indexCount; ++i)
-                    {
-                        unsigned int index = static_cast<unsigned int>(cgltf_accessor_read_index(primitive->indices, i));
-                        indices.push_back(index);
-                    }
-                }
-                // Loop over the attributes of the current mesh primitive
-                unsigned int numAttributes = static_cast<unsigned int>(primitive->attributes_count);
-                for (unsigned int attributeIndex = 0; attributeIndex < numAttributes; ++attributeIndex)
-                {
-                    // Get the current attribute
-                    cgltf_attribute *attribute = &primitive->attributes[attributeIndex];
-                    // Read the values of the current attribute and store them in the current mesh
-                    addAttribute(*attribute);
-                }
+                addPrimitive(mesh->primitives[primitiveIndex]);
             }
         }
     }
@@ -0,0 +1,151 @@
+#ifndef OCCLUSION_CULLER_HPP
+#define OCCLUSION_CULLER_HPP
+#pragma once
+
+#include <unordered_map>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "options.hpp"
+#include "sceneNode.hpp"
+#include "shader.hpp"
+#include "utilities/glState.hpp"
+
+
+
+/**
+ * Skips drawing nodes that are completely hidden behind geometry that has already been drawn.
+ *
+ * Before a node is drawn, its bounding box is rasterized against the depth buffer inside an occlusion query (without
+ * writing anything). The node itself is then drawn with conditional rendering, so the GPU throws the draw away if no
+ * sample of the box passed the depth test. Everything happens on the GPU, the CPU never waits for a query result.
+ *
+ * Since the scene is drawn front to back, the nodes drawn first are the ones that hide the others. This works the same
+ * for the main view and every side of the environment maps.
+ */
+class OcclusionCuller
+{
+private:
+    Shader *boundsShader;
+    unsigned int cubeVAO;
+
+    // One query per node, it is reused for every view as the conditional draw always follows right after the test
+    std::unordered_map<SceneNode *, GLuint> queries;
+    // Nodes that have been tested in the current view
+    std::unordered_map<SceneNode *, bool> tested;
+
+public:
+    unsigned int testsIssued = 0;
+
+    OcclusionCuller()
+    {
+        boundsShader = new Shader("bounds.vert", "depth.frag");
+
+        float corners[8 * 3] = {
+            -1, -1, -1,
+            1, -1, -1,
+            1, 1, -1,
+            -1, 1, -1,
+            -1, -1, 1,
+            1, -1, 1,
+            1, 1, 1,
+            -1, 1, 1
+        };
+        GLushort indices[36] = {
+            0, 2, 1, 0, 3, 2, // back
+            4, 5, 6, 4, 6, 7, // front
+            0, 1, 5, 0, 5, 4, // bottom
+            3, 6, 2, 3, 7, 6, // top
+            0, 4, 7, 0, 7, 3, // left
+            1, 2, 6, 1, 6, 5  // right
+        };
+
+        unsigned int buffers[2];
+        glCreateBuffers(2, buffers);
+        glNamedBufferStorage(buffers[0], sizeof(corners), corners, 0);
+        glNamedBufferStorage(buffers[1], sizeof(indices), indices, 0);
+        glCreateVertexArrays(1, &cubeVAO);
+        glVertexArrayVertexBuffer(cubeVAO, 0, buffers[0], 0, 3 * sizeof(float));
+        glVertexArrayElementBuffer(cubeVAO, buffers[1]);
+        glVertexArrayAttribFormat(cubeVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(cubeVAO, 0, 0);
+        glEnableVertexArrayAttrib(cubeVAO, 0);
+    }
+
+    /** Forget all tests, call before rendering a new view */
+    void beginView()
+    {
+        tested.clear();
+    }
+
+    /**
+     * @brief Rasterizes the node's bounding box against the current depth buffer inside an occlusion query.
+     * Nodes that contain the eye (or are very close to it) are not tested, as their box may be clipped by the near plane.
+     *
+     * @param node The node that is about to be drawn
+     * @param view View Matrix
+     * @param projection Projection Matrix
+     * @param eyePosition The position the scene is seen from
+     */
+    void test(SceneNode *node, glm::mat4 view, glm::mat4 projection, glm::vec3 eyePosition)
+    {
+        if (!OPTIONS::occlusionCulling || tested.count(node)) return;
+
+        // Box of the node in model space, slightly enlarged so the near plane never cuts it
+        glm::vec3 margin    = glm::vec3(OPTIONS::nearClippingPlane * 2.0f);
+        glm::vec3 localEye  = glm::vec3(glm::inverse(node->M) * glm::vec4(eyePosition, 1));
+        glm::vec3 extent    = node->bounds.size() * 0.5f;
+        glm::vec3 scale     = glm::vec3(glm::length(glm::vec3(node->M[0])), glm::length(glm::vec3(node->M[1])), glm::length(glm::vec3(node->M[2])));
+        glm::vec3 padding   = margin / glm::max(scale, glm::vec3(1e-6f));
+        glm::vec3 boxMin    = node->bounds.min - padding;
+        glm::vec3 boxMax    = node->bounds.max + padding;
+        bool containsEye    = glm::all(glm::greaterThanEqual(localEye, boxMin)) && glm::all(glm::lessThanEqual(localEye, boxMax));
+        if (containsEye) return;
+
+        GLuint &query = queries[node];
+        if (query == 0) glCreateQueries(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, 1, &query);
+
+        glm::mat4 box = node->M * glm::translate(node->bounds.center()) * glm::scale(extent + padding);
+
+        boundsShader->activate();
+        boundsShader->setUniform(UNIFORMS::V, view);
+        boundsShader->setUniform(UNIFORMS::P, projection);
+        boundsShader->setUniform(UNIFORMS::B, box);
+
+        // Only test, dont write anything. The state is restored after, since this is also called during the depth pre-pass.
+        // Both sides are rasterized so the box is visible even if the eye is close to it
+        GLboolean depthWrites = GLSTATE::getDepthMask();
+        GLboolean colorWrites = GLSTATE::getColorMask();
+        GLboolean culling     = GLSTATE::getCullFace();
+        GLSTATE::colorMask(GL_FALSE);
+        GLSTATE::depthMask(GL_FALSE);
+        GLSTATE::cullFace(GL_FALSE);
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, query);
+        GLSTATE::bindVertexArray(cubeVAO);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
+        glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+        GLSTATE::cullFace(culling);
+        GLSTATE::depthMask(depthWrites);
+        GLSTATE::colorMask(colorWrites);
+
+        tested[node] = true;
+        testsIssued++;
+    }
+
+    /** Start drawing the node, if it was tested the draw calls until end() are skipped by the GPU if it was hidden */
+    void begin(SceneNode *node)
+    {
+        if (tested.count(node)) glBeginConditionalRender(queries[node], GL_QUERY_WAIT);
+    }
+
+    void end(SceneNode *node)
+    {
+        if (tested.count(node)) glEndConditionalRender();
+    }
+};
+
+#endif
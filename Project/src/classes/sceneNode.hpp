@@ -2,15 +2,28 @@
 #define SCENENODE_HPP
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
-#include "classes/image.hpp"
+#include "assetLoader.hpp"
 #include "classes/shader.hpp"
 #include "framebuffer.hpp"
+#include "managers/materialManager.hpp"
 #include "mesh.hpp"
+#include "streamBuffer.hpp"
+#include "threadPool.hpp"
+#include "utilities/meshCache.hpp"
+#include "utilities/meshOptimizer.hpp"
+#include "utilities/tangents.hpp"
+#include "vertexLayout.hpp"
 
 
 
@@ -22,19 +35,97 @@ enum AppearanceType
     SUNLIT      // use color / diffuse map for color and add sunlight and shadows
 };
 
-// Keeps track of all three texture types im using
-struct Textures
+// Part of the index buffer drawn with one base vertex, every index in it is less than 2^16 after the base is subtracted
+struct IndexChunk
 {
-    bool hasTextures = false;
-    int diffuseID    = -1;
-    int normalID     = -1;
-    int roughnessID  = -1;
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+    int baseVertex          = 0;
+};
+
+// Part of the index buffer drawn for one level of detail
+struct IndexRange
+{
+    unsigned int firstIndex   = 0;
+    unsigned int indexCount   = 0;
+    float error               = 0; // model space distance from the full mesh
+    unsigned int firstMeshlet = 0; // the meshlets covering the range, in VAO::meshlets
+    unsigned int meshletCount = 0;
+    unsigned int firstChunk   = 0; // the chunks covering the range, in VAO::chunks
+    unsigned int chunkCount   = 0;
 };
 
 struct VAO
 {
-    int ID         = -1;
-    int indexCount = -1;
+    int ID           = -1;
+    int indexCount   = -1;
+    GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT unless a chunk could not be made small enough
+    GLenum uvType    = GL_UNSIGNED_SHORT; // of Vertex::textureCoordinates, GL_HALF_FLOAT if a UV is outside 0 - 1
+    std::vector<IndexRange> lods;       // lods[0] is the full mesh, then coarser and coarser
+    std::vector<Meshlet> meshlets;      // of all levels, with indices into the whole index buffer
+    std::vector<IndexChunk> chunks;     // of all levels
+
+    size_t indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    }
+};
+
+// Layout of one command for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+
+
+// One vertex as it is stored on the GPU (24 bytes), all attributes interleaved in a single buffer (locations as in main.vert).
+// The bitangent is not stored, main.vert computes it from the normal and the tangent, flipped by the handedness in tangent.w
+// The texture coordinates are 16 bit normalized when all of the mesh's are in 0 - 1, and half floats when it tiles
+struct Vertex
+{
+    glm::vec3 position;
+    PackedSnorm4 normal;
+    PackedSnorm4 tangent;
+    GLuint textureCoordinates = 0; // the bits of a PackedUnorm2 or PackedHalf2, see VAO::uvType
+
+    static VertexLayout layout(GLenum uvType)
+    {
+        return VertexLayout::of<Vertex>()
+            .add(0, &Vertex::position)
+            .add(1, &Vertex::normal, true)
+            .add(2, &Vertex::tangent, true)
+            .add(4, &Vertex::textureCoordinates, 2, uvType, uvType == GL_UNSIGNED_SHORT);
+    }
+};
+
+
+
+// Everything about a mesh that is needed to draw it, made on the CPU and ready to be uploaded (see SceneNode::upload()).
+// It can be moved to another thread but not copied, the sections point into its own vectors
+struct MeshBuffers
+{
+    VAO vao; // all but the ID
+    Bounds bounds;
+    MESHCACHE::Section vertices; // in the Vertex format, in vertexData or the mapped cache file
+    MESHCACHE::Section indices;  // of vao.indexType, in indexData or the mapped cache file
+    std::vector<Vertex> vertexData;
+    std::vector<unsigned char> indexData;
+    std::unique_ptr<MESHCACHE::MappedFile> file; // when the buffers are in a mesh cache file
+};
+
+
+
+// The part of a node that is changed by the simulation
+struct NodeState
+{
+    glm::vec3 position;
+    glm::vec3 rotation;
+    glm::vec3 scale;
 };
 
 
@@ -53,6 +144,9 @@ public:
     // The location of the node's reference point
     glm::vec3 referencePoint;
 
+    // Transformation the node was imported with (see fromGLTF), position, rotation and scale are applied after it
+    glm::mat4 localTransform = glm::mat4(1);
+
     // Transformation matrix representing the transformation of the node's location/rotation/scale
     glm::mat4 M;
     // The Normal (Transformation) Matrix for this nodes normals
@@ -60,15 +154,24 @@ public:
 
     // Information about vertices for this node
     VAO vao;
+    // Bounding box of the node's mesh (in model space)
+    Bounds bounds;
+
+    // Framebuffer used to store the dynamic environment cubemap for this specific node, see getEnvironmentBuffer()
+    Framebuffer *environmentBuffer = nullptr;
+    int environmentResolution      = OPTIONS::environmentBufferResolution;
+    bool hasEnvironmentMap         = false;
 
-    // Framebuffer used to store the dynamic environment cubemap for this specific node
-    Framebuffer *environmentBuffer;
-    bool hasEnvironmentMap = false;
+    // Level of detail chosen for the view being drawn, see selectLOD()
+    int lod = 0;
+    // Draw commands for the meshlets of that level that are visible in the view, see cullMeshlets()
+    StreamAllocation meshletCommands;
+    int meshletCommandCount = -1; // -1 to draw the whole level without culling
 
     // How the node should be render
     AppearanceType appearance;
-    // Information about relevant textures (and if it has any)
-    Textures textures;
+    // Which material (set of texture maps) in the MaterialManager this node uses, -1 if it has none
+    int materialID = -1;
 
 
 
@@ -78,20 +181,154 @@ public:
         rotation       = glm::vec3(0, 0, 0);
         scale          = glm::vec3(1, 1, 1);
         referencePoint = glm::vec3(0, 0, 0);
+    }
+
+
 
-        environmentBuffer = new Framebuffer(OPTIONS::environmentBufferResolution);
+    /**
+     * @brief Initializes a SceneNode with VAO and VAI index count from a mesh
+     *
+     * @param workers Splits the work of generating tangents for big meshes, if given
+     * @param cacheSource If not empty, what is made from the mesh is written to the mesh cache of this source file
+     */
+    static SceneNode *fromMesh(Mesh mesh, AppearanceType appearance, ThreadPool *workers = nullptr, std::string const &cacheSource = "")
+    {
+        MeshBuffers buffers = prepareMesh(std::move(mesh), workers, cacheSource);
+        SceneNode *node     = new SceneNode();
+        node->appearance    = appearance;
+        node->upload(buffers);
+        return node;
+    }
+
+    /**
+     * @brief Everything fromMesh() does to the mesh before uploading it, without OpenGL so it can be done on any thread
+     *
+     * @param workers Splits the work of generating tangents for big meshes, if given
+     * @param cacheSource If not empty, the buffers are also written to the mesh cache of this source file
+     */
+    static MeshBuffers prepareMesh(Mesh mesh, ThreadPool *workers = nullptr, std::string const &cacheSource = "")
+    {
+        TANGENTS::generate(mesh, workers);
+        if (OPTIONS::optimizeMeshes) MESHOPT::optimize(mesh);
+        if (0 < OPTIONS::lodLevels) MESHOPT::generateLODs(mesh);
+        if (OPTIONS::meshletCulling) MESHOPT::buildMeshlets(mesh);
+
+        MeshBuffers buffers;
+        generateBuffers(mesh, buffers, cacheSource);
+        return buffers;
     }
 
 
 
-    /** Initializes a SceneNode with VAO and VAI index count from a mesh */
-    static SceneNode *fromMesh(Mesh mesh, AppearanceType appearance)
+    /**
+     * @brief A node made from the mesh cache of the source file (see MESHCACHE), uploaded straight from the mapped
+     * cache file without any processing
+     *
+     * @return nullptr if there is no up to date cache file for the source
+     */
+    static SceneNode *fromCache(std::string const &source, AppearanceType appearance)
     {
-        SceneNode *node      = new SceneNode();
-        node->vao.ID         = generateBuffer(mesh);
-        node->vao.indexCount = (unsigned int)mesh.indices.size();
-        node->appearance     = appearance;
-        if (OPTIONS::verbose) printf("Created SceneNode with: %d indices, %d vertices\n", node->vao.indexCount, mesh.vertices.size());
+        MeshBuffers buffers;
+        if (!readCache(source, buffers)) return nullptr;
+        SceneNode *node  = new SceneNode();
+        node->appearance = appearance;
+        node->upload(buffers);
+        return node;
+    }
+
+    /**
+     * @brief Maps the mesh cache of the source file, without OpenGL so it can be done on any thread
+     *
+     * @param buffers (Output) Pointing into the mapped cache file, which they keep open
+     * @return false if there is no up to date cache file for the source
+     */
+    static bool readCache(std::string const &source, MeshBuffers &buffers)
+    {
+        TRACE::Scope scope("load mesh cache " + source, "loading");
+        std::vector<MESHCACHE::Section> sections;
+        std::unique_ptr<MESHCACHE::MappedFile> file(MESHCACHE::read(source, sections));
+        if (!file) return false;
+
+        // Sections that do not fit the current formats are from another version of the program
+        bool valid = sections.size() == 6 && sections[0].size == sizeof(CachedMesh) && sections[1].size % sizeof(Vertex) == 0
+                  && sections[3].size % sizeof(IndexRange) == 0 && sections[4].size % sizeof(Meshlet) == 0
+                  && sections[5].size % sizeof(IndexChunk) == 0;
+        if (!valid) return false;
+
+        CachedMesh const &info = *static_cast<CachedMesh const *>(sections[0].data);
+        buffers.vao.indexCount = info.indexCount;
+        buffers.vao.indexType  = info.indexType;
+        buffers.vao.uvType     = info.uvType;
+        buffers.vao.lods       = fromSection<IndexRange>(sections[3]);
+        buffers.vao.meshlets   = fromSection<Meshlet>(sections[4]);
+        buffers.vao.chunks     = fromSection<IndexChunk>(sections[5]);
+        buffers.bounds         = info.bounds;
+        buffers.vertices       = sections[1];
+        buffers.indices        = sections[2];
+        buffers.file           = std::move(file);
+        return true;
+    }
+
+    /**
+     * @brief Uploads the buffers to a new VAO, and draws that from now on. Closes the cache file the buffers were in
+     */
+    void upload(MeshBuffers &buffers)
+    {
+        vao    = buffers.vao;
+        vao.ID = uploadBuffers(buffers.vertices.data, buffers.vertices.size, buffers.indices.data, buffers.indices.size, vao.uvType);
+        bounds = buffers.bounds;
+        buffers.file.reset();
+        if (OPTIONS::verbose)
+            printf("Created SceneNode with: %d indices (%d bit, %zu chunks), %zu vertices\n", vao.indexCount,
+                   vao.indexType == GL_UNSIGNED_SHORT ? 16 : 32, vao.chunks.size(), buffers.vertices.size / sizeof(Vertex));
+    }
+
+
+
+    /**
+     * @brief Imports the scene of a glTF file as a tree of nodes like the file's, each with its transformation. The
+     * primitives of a node's mesh are children of it, each drawn on its own. A mesh used by several nodes is only
+     * loaded and uploaded once, the nodes drawing it share the VAO.
+     *
+     * @param filename Relative to root
+     * @param workers Splits the work of generating tangents for big meshes, if given
+     * @return The root of the imported nodes (empty if the file could not be loaded)
+     */
+    static SceneNode *fromGLTF(std::string const &filename, AppearanceType appearance, ThreadPool *workers = nullptr,
+                               std::string const &root = "../res/models/")
+    {
+        TRACE::Scope scope("import glTF " + filename, "loading");
+        SceneNode *scene = new SceneNode();
+        cgltf_data *data = Mesh::readData((root + filename).c_str());
+        if (data == nullptr) return scene;
+
+        // The default scene, or every node without a parent if the file has no scenes
+        std::unordered_map<cgltf_mesh const *, std::vector<SceneNode *>> meshes;
+        cgltf_scene const *gltfScene = data->scene ? data->scene : (0 < data->scenes_count ? &data->scenes[0] : nullptr);
+        if (gltfScene)
+        {
+            for (cgltf_size i = 0; i < gltfScene->nodes_count; i++)
+                scene->addChild(importNode(*gltfScene->nodes[i], appearance, workers, meshes));
+        }
+        else
+        {
+            for (cgltf_size i = 0; i < data->nodes_count; i++)
+                if (data->nodes[i].parent == nullptr) scene->addChild(importNode(data->nodes[i], appearance, workers, meshes));
+        }
+
+        cgltf_free(data);
+        if (OPTIONS::verbose) printf("Imported %s: %u nodes, %zu meshes\n", filename.c_str(), scene->getNumChildren(), meshes.size());
+        return scene;
+    }
+
+    /** @brief A new node drawing the same mesh (sharing the VAO) with the same appearance and material, without children */
+    SceneNode *instance() const
+    {
+        SceneNode *node  = new SceneNode();
+        node->vao        = vao;
+        node->bounds     = bounds;
+        node->appearance = appearance;
+        node->materialID = materialID;
         return node;
     }
 
@@ -105,35 +342,161 @@ public:
      *      ../res/models/<name>/textures/<name>_01_diff_<resolution>.png
      *      ../res/models/<name>/textures/<name>_01_nor_gl_<resolution>.png
      *      ../res/models/<name>/textures/<name>_01_rough_<resolution>.png
+     *
+     * @param workers Splits the work of generating tangents for big meshes, if given and there is no loader
+     * @param loader If given, the model and textures are read by it in the background. The node is returned right away,
+     *               and is not drawn until its mesh is uploaded
      */
-    static SceneNode *fromModelName(const std::string &name, const std::string &resolution, AppearanceType appearance)
+    static SceneNode *fromModelName(const std::string &name, const std::string &resolution, AppearanceType appearance, MaterialManager *materials,
+                                    ThreadPool *workers = nullptr, AssetLoader *loader = nullptr)
     {
         std::string modelName     = name + "/" + name + "_01_" + resolution + ".gltf";
         std::string diffuseName   = name + "/textures/" + name + "_01_diff_" + resolution + ".png";
         std::string normalName    = name + "/textures/" + name + "_01_nor_gl_" + resolution + ".png";
         std::string roughnessName = name + "/textures/" + name + "_01_rough_" + resolution + ".png";
 
-        Mesh mesh       = Mesh(modelName);
-        SceneNode *node = fromMesh(mesh, appearance);
-        addTextureMaps(node, diffuseName, normalName, roughnessName);
+        // Processed only the first time, later runs load what was made from the model from the mesh cache
+        std::string root   = "../res/models/";
+        std::string source = OPTIONS::meshCache ? root + modelName : "";
+        auto read          = [modelName, root, source](ThreadPool *threads) {
+            MeshBuffers buffers;
+            if (!source.empty() && readCache(source, buffers)) return buffers;
+            return prepareMesh(Mesh(modelName, root), threads, source);
+        };
+
+        SceneNode *node  = new SceneNode();
+        node->appearance = appearance;
+        if (loader)
+        {
+            // The workers are not used, they are busy with the frames drawn in the meantime
+            loader->load<MeshBuffers>(
+                modelName, [read]() { return read(nullptr); }, [node](MeshBuffers &buffers) { node->upload(buffers); });
+            node->materialID = materials->loadMaterial(diffuseName, normalName, roughnessName, loader);
+        }
+        else
+        {
+            MeshBuffers buffers = read(workers);
+            node->upload(buffers);
+            node->materialID = materials->addMaterial(diffuseName, normalName, roughnessName);
+        }
         return node;
     }
 
 
+    /**
+     * @brief The framebuffer for this node's environment map, created the first time it is needed.
+     * Most nodes are never reflective or refractive, and should not hold on to a cubemap (or need an OpenGL context).
+     */
+    Framebuffer *getEnvironmentBuffer()
+    {
+        if (!environmentBuffer) environmentBuffer = new Framebuffer(environmentResolution);
+        return environmentBuffer;
+    }
+
     void increaseEnvironmentResolution()
     {
-        int newResolution = environmentBuffer->width * 2;
-        if (2048 < newResolution) return;
-        environmentBuffer = new Framebuffer(newResolution);
-        hasEnvironmentMap = false;
+        if (2048 < environmentResolution * 2) return;
+        setEnvironmentResolution(environmentResolution * 2);
     }
 
     void decreaseEnvironmentResolution()
     {
-        int newResolution = environmentBuffer->width / 2;
-        if (newResolution < 32) return;
-        environmentBuffer = new Framebuffer(newResolution);
-        hasEnvironmentMap = false;
+        if (environmentResolution / 2 < 32) return;
+        setEnvironmentResolution(environmentResolution / 2);
+    }
+
+
+    /**
+     * @brief Chooses the coarsest level of detail that is at most maxPixelError pixels off on screen, it is drawn
+     * until the next call so the depth pre-pass and the shading pass of a view use the same triangles
+     *
+     * @param eyePosition The position the node is seen from
+     * @param projection Projection Matrix of the view
+     * @param viewportHeight Height of the view in pixels
+     * @param maxPixelError How far off (in pixels) the simplified surface may be
+     */
+    void selectLOD(glm::vec3 eyePosition, glm::mat4 const &projection, int viewportHeight, float maxPixelError)
+    {
+        lod = 0;
+        if (vao.lods.size() < 2) return;
+
+        // Distance to the bounding sphere, and how many pixels one unit covers there
+        float scale      = std::max(glm::length(glm::vec3(M[0])), std::max(glm::length(glm::vec3(M[1])), glm::length(glm::vec3(M[2]))));
+        glm::vec3 center = glm::vec3(M * glm::vec4(bounds.center(), 1));
+        float distance   = glm::length(center - eyePosition) - glm::length(bounds.size()) * 0.5f * scale;
+        if (distance <= 0) return;
+        float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f / distance;
+
+        while (lod + 1 < (int)vao.lods.size() && vao.lods[lod + 1].error * scale * pixelsPerUnit <= maxPixelError) lod++;
+    }
+
+
+    /**
+     * @brief Finds the meshlets of the chosen level of detail that can be seen in the view, those outside the frustum or
+     * facing away from the eye are left out. The draw commands for the rest are written to the frame data and used by
+     * render() until the next call. Assumes the node is scaled the same along all axes.
+     *
+     * @param view View Matrix
+     * @param projection Projection Matrix
+     * @param eyePosition The position the node is seen from
+     * @param workers The meshlets are tested in parallel on these
+     * @param frameData Where the draw commands are written
+     */
+    void cullMeshlets(glm::mat4 const &view, glm::mat4 const &projection, glm::vec3 eyePosition, ThreadPool *workers, StreamBuffer *frameData)
+    {
+        meshletCommandCount = -1;
+        if (vao.lods.empty()) return;
+        IndexRange const &range = vao.lods[lod];
+        if (range.meshletCount == 0) return;
+
+        // Frustum planes and eye in model space, so the meshlet bounds can be tested as they are
+        glm::mat4 clip = projection * view * M;
+        glm::vec4 planes[6];
+        glm::vec4 w = glm::vec4(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+        for (int i = 0; i < 3; i++)
+        {
+            glm::vec4 row     = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+            planes[i * 2]     = w + row;
+            planes[i * 2 + 1] = w - row;
+        }
+        for (glm::vec4 &plane : planes) plane /= glm::length(glm::vec3(plane));
+        glm::vec3 eye = glm::vec3(glm::inverse(M) * glm::vec4(eyePosition, 1));
+
+        meshletVisible.resize(range.meshletCount);
+        workers->parallelFor(range.meshletCount, 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                Meshlet const &meshlet = vao.meshlets[range.firstMeshlet + i];
+                bool visible           = true;
+                for (glm::vec4 const &plane : planes) visible = visible && -meshlet.radius <= glm::dot(glm::vec3(plane), meshlet.center) + plane.w;
+
+                glm::vec3 offset = meshlet.center - eye;
+                if (meshlet.coneCutoff * glm::length(offset) + meshlet.radius <= glm::dot(offset, meshlet.coneAxis)) visible = false;
+                meshletVisible[i] = visible;
+            }
+        });
+
+        // One command for each run of visible meshlets, they are next to each other in the index buffer
+        commands.clear();
+        for (unsigned int i = 0; i < range.meshletCount; i++)
+        {
+            if (!meshletVisible[i]) continue;
+            Meshlet const &meshlet = vao.meshlets[range.firstMeshlet + i];
+            if (0 < i && meshletVisible[i - 1] && commands.back().baseVertex == meshlet.baseVertex)
+                commands.back().count += meshlet.indexCount;
+            else
+                commands.push_back({ meshlet.indexCount, 1, meshlet.firstIndex, meshlet.baseVertex, 0 });
+        }
+        meshletCommandCount = (int)commands.size();
+        if (commands.empty()) return;
+
+        meshletCommands = frameData->allocate(commands.size() * sizeof(DrawElementsIndirectCommand), 4);
+        if (!meshletCommands.isValid())
+        {
+            meshletCommandCount = -1; // draw everything instead
+            return;
+        }
+        memcpy(meshletCommands.data, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
     }
 
 
@@ -144,19 +507,36 @@ public:
      */
     void updateTransformations(glm::mat4 parentModelMatrix)
     {
-        glm::mat4 myTransformation = glm::translate(position)
+        updateTransformations(parentModelMatrix, getState());
+
+        // Update children
+        for (SceneNode *child : children) child->updateTransformations(M);
+    }
+
+    /**
+     * @brief Updates the transformations of this node only, from the given state instead of the node's own
+     * (used by the renderer, which draws the state from the simulation snapshots)
+     *
+     * @param parentModelMatrix Model Transformation Matrix of this nodes parent
+     * @param state Position, rotation and scale to use
+     */
+    void updateTransformations(glm::mat4 parentModelMatrix, NodeState const &state)
+    {
+        glm::mat4 myTransformation = glm::translate(state.position)
                                    * glm::translate(referencePoint)
-                                   * glm::rotate(rotation.y, glm::vec3(0, 1, 0))
-                                   * glm::rotate(rotation.x, glm::vec3(1, 0, 0))
-                                   * glm::rotate(rotation.z, glm::vec3(0, 0, 1))
-                                   * glm::scale(scale)
+                                   * glm::rotate(state.rotation.y, glm::vec3(0, 1, 0))
+                                   * glm::rotate(state.rotation.x, glm::vec3(1, 0, 0))
+                                   * glm::rotate(state.rotation.z, glm::vec3(0, 0, 1))
+                                   * glm::scale(state.scale)
                                    * glm::translate(-referencePoint);
 
-        M = parentModelMatrix * myTransformation;
+        M = parentModelMatrix * myTransformation * localTransform;
         N = glm::mat3(glm::transpose(glm::inverse(M)));
+    }
 
-        // Update children
-        for (SceneNode *child : children) child->updateTransformations(M);
+    NodeState getState()
+    {
+        return { position, rotation, scale };
     }
 
 
@@ -169,30 +549,53 @@ public:
      * I have to do this to prevent the node trying to sample itself when creating the environment map, which creates ugly artifacts.
      * The ideal way to solve this would have the node be able to reflect itself, but i dont have time figure that out :/
      *
+     * Material textures are bound by the MaterialManager before this is called.
+     *
      * @param shader Which shader to use for rendering
+     * @param frameData Stream buffer the node's transformations are uploaded through
      */
-    void render(Shader *shader)
+    void render(Shader *shader, StreamBuffer *frameData)
     {
         if (vao.ID == -1 || vao.indexCount <= 0) return;
 
-        shader->setUniform(UNIFORMS::M, M);
-        shader->setUniform(UNIFORMS::N, N);
+        // Upload transformations for this draw only
+        ObjectBlock object;
+        object.M = M;
+        for (int i = 0; i < 3; i++) object.N[i] = glm::vec4(N[i], 0);
+        StreamAllocation allocation = frameData->upload(object, frameData->getUniformAlignment());
+        if (!allocation.isValid()) return;
+        frameData->bindUniformBlock(BLOCKS::object, allocation);
 
         // let the shader know if it should use textures or not
-        shader->setUniform(UNIFORMS::has_textures, textures.hasTextures);
-        if (textures.hasTextures)
+        shader->setUniform(UNIFORMS::has_textures, materialID != -1);
+
+        // If node has environment map, use it instead of the regular skybox (which stays bound for the entire pass)
+        shader->setUniform(UNIFORMS::has_environment, hasEnvironmentMap);
+        if (hasEnvironmentMap) GLSTATE::bindTextureUnit(BINDINGS::environment, environmentBuffer->textureID);
+
+        // Finally render the nodes mesh, at the level of detail chosen for this view and only the visible meshlets of it
+        IndexRange const &range = vao.lods[std::min(lod, (int)vao.lods.size() - 1)];
+        GLSTATE::bindVertexArray(vao.ID);
+        if (meshletCommandCount < 0)
+        {
+            for (unsigned int i = range.firstChunk; i < range.firstChunk + range.chunkCount; i++)
+            {
+                IndexChunk const &chunk = vao.chunks[i];
+                void *offset            = (void *)(chunk.firstIndex * vao.indexSize());
+                glDrawElementsBaseVertex(GL_TRIANGLES, chunk.indexCount, vao.indexType, offset, chunk.baseVertex);
+            }
+        }
+        else if (0 < meshletCommandCount)
         {
-            glBindTextureUnit(BINDINGS::diffuse_map, textures.diffuseID);
-            glBindTextureUnit(BINDINGS::normal_map, textures.normalID);
-            glBindTextureUnit(BINDINGS::roughness_map, textures.roughnessID);
+            frameData->bindDrawIndirect();
+            glMultiDrawElementsIndirect(GL_TRIANGLES, vao.indexType, (void *)meshletCommands.offset, meshletCommandCount, 0);
         }
+    }
 
-        // If node has environment map, replace the regular skybox
-        if (hasEnvironmentMap) glBindTextureUnit(BINDINGS::skybox, environmentBuffer->textureID);
-
-        // Finally render the nodes mesh
-        glBindVertexArray(vao.ID);
-        glDrawElements(GL_TRIANGLES, vao.indexCount, GL_UNSIGNED_INT, nullptr);
+    // Position of the node in world space (from the last updateTransformations())
+    glm::vec3 getWorldPosition()
+    {
+        return glm::vec3(M[3]);
     }
 
     // Add a child node to its parent's list of children
@@ -252,186 +655,254 @@ public:
 
 
 private:
+    // Reused by cullMeshlets() so it does not allocate every view
+    std::vector<unsigned char> meshletVisible;
+    std::vector<DrawElementsIndirectCommand> commands;
+
+    // The framebuffer is recreated at the new resolution the next time it is used
+    void setEnvironmentResolution(int resolution)
+    {
+        environmentResolution = resolution;
+        environmentBuffer     = nullptr;
+        hasEnvironmentMap     = false;
+    }
+
+
+
     /**
-     * @brief Creates the VAO and VBO for this node using a mesh, if mesh contains texture coordinates then it
-     * computes the tangents and bitangents as well. Sends all mesh info to vertex shader.
+     * @brief Makes the buffers of the VAO for a mesh, with the tangents of the mesh if it has them. All attributes
+     * are interleaved into one immutable vertex buffer, and the indices of all levels of detail go one after the other
+     * into one index buffer. The indices are 16 bit, meshes with more vertices than that can reach are drawn in chunks,
+     * each with its own base vertex.
      *
      * @param mesh
-     * @return VAO ID
+     * @param buffers (Output) the buffers, and in buffers.vao where the part of the index buffer of each level, their
+     *                meshlets and chunks are
+     * @param cacheSource If not empty, the buffers are also written to the mesh cache of this source file
      */
-    static unsigned int generateBuffer(Mesh &mesh)
+    static void generateBuffers(Mesh &mesh, MeshBuffers &buffers, std::string const &cacheSource = "")
     {
-        // Create VAO
-        unsigned int vaoID;
-        glGenVertexArrays(1, &vaoID);
-        glBindVertexArray(vaoID);
-
-        // create Index Buffer
-        unsigned int indexBufferID;
-        glGenBuffers(1, &indexBufferID);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
-
-        // Compute tangents and bitangents
-        std::vector<glm::vec3> tangents, bitangents;
-        if (mesh.textureCoordinates.size() > 0)
+        // Interleave and pack everything, missing attributes are left as zero. Normalized 16 bit UVs are more precise
+        // than half floats, but only hold 0 - 1, so a mesh that tiles its textures gets half floats
+        VAO &vao                      = buffers.vao;
+        std::vector<Vertex> &vertices = buffers.vertexData;
+        vao.uvType                    = GL_UNSIGNED_SHORT;
+        for (glm::vec2 const &uv : mesh.textureCoordinates)
+            if (uv.x < 0 || 1 < uv.x || uv.y < 0 || 1 < uv.y) vao.uvType = GL_HALF_FLOAT;
+        vertices.assign(mesh.vertices.size(), Vertex());
+        for (size_t i = 0; i < vertices.size(); i++)
         {
-            computeTangentBasis(mesh.vertices, mesh.textureCoordinates, mesh.indices, tangents, bitangents);
+            glm::vec3 normal     = i < mesh.normals.size() ? safeNormalize(mesh.normals[i]) : glm::vec3(0);
+            vertices[i].position = mesh.vertices[i];
+            vertices[i].normal   = glm::vec4(normal, 0);
+            if (i < mesh.tangents.size()) vertices[i].tangent = mesh.tangents[i];
+            if (i < mesh.textureCoordinates.size())
+            {
+                glm::vec2 uv                   = mesh.textureCoordinates[i];
+                vertices[i].textureCoordinates = vao.uvType == GL_UNSIGNED_SHORT ? PackedUnorm2(uv).bits : PackedHalf2(uv).bits;
+            }
         }
 
-        // Pass all info to the vertex shader
-        generateAttribute(0, 3, mesh.vertices);
-        generateAttribute(1, 3, mesh.normals, true);
-        generateAttribute(2, 3, tangents, true);
-        generateAttribute(3, 3, bitangents, true);
-        generateAttribute(4, 2, mesh.textureCoordinates);
+        // All levels of detail after each other, and their meshlets moved to where the level is
+        std::vector<unsigned int> indices;
+        vao.indexType = GL_UNSIGNED_SHORT;
+        addLOD(vao, indices, mesh.indices, 0, mesh.meshlets);
+        for (LevelOfDetail const &lod : mesh.lods) addLOD(vao, indices, lod.indices, lod.error, lod.meshlets);
 
-        return vaoID;
-    }
+        // When the indices jump around too much the chunks get small, and the extra draws cost more than the 16 bit
+        // indices save. Then (or when a meshlet or triangle alone is too wide) each level is drawn with 32 bit indices
+        if (vao.indexType == GL_UNSIGNED_INT || vao.lods.size() + indices.size() / 0x8000 < vao.chunks.size())
+        {
+            vao.indexType = GL_UNSIGNED_INT;
+            vao.chunks.clear();
+            for (IndexRange &range : vao.lods)
+            {
+                range.firstChunk = (unsigned int)vao.chunks.size();
+                range.chunkCount = 1;
+                vao.chunks.push_back({ range.firstIndex, range.indexCount, 0 });
+            }
+            for (Meshlet &meshlet : vao.meshlets) meshlet.baseVertex = 0;
+        }
 
+        // Indices relative to the base vertex of their chunk, which is what the draws add back
+        for (IndexChunk const &chunk : vao.chunks)
+            for (unsigned int i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; i++) indices[i] -= chunk.baseVertex;
+        buffers.indexData.resize(indices.size() * vao.indexSize());
+        if (vao.indexType == GL_UNSIGNED_SHORT)
+        {
+            std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+            memcpy(buffers.indexData.data(), shortIndices.data(), buffers.indexData.size());
+        }
+        else
+            memcpy(buffers.indexData.data(), indices.data(), buffers.indexData.size());
 
+        vao.indexCount   = (int)mesh.indices.size();
+        buffers.bounds   = mesh.getBounds();
+        buffers.vertices = { vertices.data(), vertices.size() * sizeof(Vertex) };
+        buffers.indices  = { buffers.indexData.data(), buffers.indexData.size() };
+
+        if (!cacheSource.empty())
+        {
+            CachedMesh info = { vao.indexCount, vao.indexType, vao.uvType, buffers.bounds };
+            MESHCACHE::write(cacheSource, { { &info, sizeof(info) },
+                                            buffers.vertices,
+                                            buffers.indices,
+                                            { vao.lods.data(), vao.lods.size() * sizeof(IndexRange) },
+                                            { vao.meshlets.data(), vao.meshlets.size() * sizeof(Meshlet) },
+                                            { vao.chunks.data(), vao.chunks.size() * sizeof(IndexChunk) } });
+        }
+    }
 
     /**
-     * @brief Sends the data as an attribute to the vertex shader at location "id"
+     * @brief Creates the VAO with an immutable vertex buffer (in the Vertex format) and index buffer from the data
      *
-     * @tparam T
-     * @param id location in the vertex shader
-     * @param elementsPerEntry number of elements per entry
-     * @param data data to send
-     * @param normalize Wether to normalize the data or not
-     * @return VAO id
+     * @param uvType How the texture coordinates in the vertices are packed, see VAO::uvType
      */
-    template <class T>
-    static void generateAttribute(int id, int elementsPerEntry, std::vector<T> data, bool normalize = false)
+    static unsigned int uploadBuffers(const void *vertices, size_t vertexBytes, const void *indices, size_t indexBytes, GLenum uvType)
     {
-        unsigned int bufferID;
-        glGenBuffers(1, &bufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, bufferID);
-        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(T), data.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(id, elementsPerEntry, GL_FLOAT, normalize ? GL_TRUE : GL_FALSE, sizeof(T), 0);
-        glEnableVertexAttribArray(id);
-    }
+        unsigned int vaoID;
+        glCreateVertexArrays(1, &vaoID);
+        if (vertexBytes == 0 || indexBytes == 0) return vaoID;
+
+        // Create the vertex and index buffers, they never change so their storage is immutable
+        GLuint buffers[2];
+        glCreateBuffers(2, buffers);
+        glNamedBufferStorage(buffers[0], vertexBytes, vertices, 0);
+        glNamedBufferStorage(buffers[1], indexBytes, indices, 0);
+
+        // Describe the format to the VAO
+        static const VertexLayout unormLayout = Vertex::layout(GL_UNSIGNED_SHORT);
+        static const VertexLayout halfLayout  = Vertex::layout(GL_HALF_FLOAT);
+        VertexLayout const &layout            = uvType == GL_UNSIGNED_SHORT ? unormLayout : halfLayout;
+        glVertexArrayVertexBuffer(vaoID, 0, buffers[0], 0, layout.stride);
+        glVertexArrayElementBuffer(vaoID, buffers[1]);
+        layout.apply(vaoID, 0);
 
+        return vaoID;
+    }
 
+    // First section of a mesh cache file, the others are the vertices, the indices, and the VAO's lods, meshlets and chunks
+    struct CachedMesh
+    {
+        int indexCount;
+        GLenum indexType;
+        GLenum uvType;
+        Bounds bounds;
+    };
 
-    /**
-     * @brief Initialize a texture with data from the image and return its texture ID
-     *
-     * @param texture the loaded image
-     */
-    static unsigned int initTexture(Image texture)
+    // The array stored in a section of a mesh cache file
+    template <class T>
+    static std::vector<T> fromSection(MESHCACHE::Section const &section)
     {
-        unsigned int textureID;
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels.data());
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        return textureID;
+        const T *values = static_cast<const T *>(section.data);
+        return std::vector<T>(values, values + section.size / sizeof(T));
     }
 
 
 
-    /**
-     * @brief Calculates Tangents and Bitangents
-     *
-     * Based on: http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-13-normal-mapping/
-     *
-     * @param vertices Vertices of Mesh
-     * @param uvs Texture Coordinates of mesh
-     * @param indices Indices of Mesh
-     * @param tangents (Output) where the tangents will be stored
-     * @param bitangents (Outputs) where the bitangents will be stored
-     */
-    static void computeTangentBasis(
-        std::vector<glm::vec3> &vertices,
-        std::vector<glm::vec2> &uvs,
-        std::vector<unsigned int> &indices,
-        std::vector<glm::vec3> &tangents,
-        std::vector<glm::vec3> &bitangents)
-    {
-        for (int i = 0; (i + 2) < indices.size(); i += 3)
+    static void addLOD(VAO &vao, std::vector<unsigned int> &indices, std::vector<unsigned int> const &lodIndices, float error, std::vector<Meshlet> const &meshlets)
+    {
+        IndexRange range;
+        range.firstIndex   = (unsigned int)indices.size();
+        range.indexCount   = (unsigned int)lodIndices.size();
+        range.error        = error;
+        range.firstMeshlet = (unsigned int)vao.meshlets.size();
+        range.meshletCount = (unsigned int)meshlets.size();
+        range.firstChunk   = (unsigned int)vao.chunks.size();
+
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+        for (Meshlet meshlet : meshlets)
         {
-            // Shortcuts for vertices
-            glm::vec3 &v0 = vertices[indices[i + 0]];
-            glm::vec3 &v1 = vertices[indices[i + 1]];
-            glm::vec3 &v2 = vertices[indices[i + 2]];
-
-            // Shortcuts for UVs
-            glm::vec2 &uv0 = uvs[indices[i + 0]];
-            glm::vec2 &uv1 = uvs[indices[i + 1]];
-            glm::vec2 &uv2 = uvs[indices[i + 2]];
-
-            // Edges of the triangle : position delta
-            glm::vec3 deltaPos1 = v1 - v0;
-            glm::vec3 deltaPos2 = v2 - v0;
-
-            // UV delta
-            glm::vec2 deltaUV1 = uv1 - uv0;
-            glm::vec2 deltaUV2 = uv2 - uv0;
-
-            float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+            meshlet.firstIndex += range.firstIndex;
+            vao.meshlets.push_back(meshlet);
+        }
 
-            glm::vec3 tangent   = glm::normalize((deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r);
-            glm::vec3 bitangent = glm::normalize((deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r);
+        // Split into chunks where no index is more than 2^16 - 1 above the smallest one (the base vertex). Meshlets are
+        // kept whole so each can be drawn with the base vertex of its chunk, without them any triangle can start a chunk
+        size_t parts = meshlets.empty() ? lodIndices.size() / 3 : meshlets.size();
+        IndexChunk chunk;
+        unsigned int low = ~0u, high = 0, firstPart = 0;
+        for (size_t part = 0; part <= parts; part++)
+        {
+            unsigned int begin = (unsigned int)lodIndices.size(), end = begin;
+            unsigned int partLow = ~0u, partHigh = 0;
+            if (part < parts)
+            {
+                begin = meshlets.empty() ? (unsigned int)part * 3 : meshlets[part].firstIndex;
+                end   = meshlets.empty() ? begin + 3 : begin + meshlets[part].indexCount;
+                for (unsigned int i = begin; i < end; i++)
+                {
+                    partLow  = std::min(partLow, lodIndices[i]);
+                    partHigh = std::max(partHigh, lodIndices[i]);
+                }
+                if (0xFFFF < partHigh - partLow) vao.indexType = GL_UNSIGNED_INT; // cannot be split small enough
+            }
 
-            for (int j = 0; j < 3; j++)
+            // Close the chunk at the end or when the part does not fit in it
+            bool fits = std::max(high, partHigh) - std::min(low, partLow) <= 0xFFFF;
+            if (0 < chunk.indexCount && (part == parts || !fits))
             {
-                tangents.push_back(tangent);
-                bitangents.push_back(bitangent);
+                chunk.baseVertex = (int)low;
+                vao.chunks.push_back(chunk);
+                if (!meshlets.empty())
+                    for (unsigned int i = firstPart; i < part; i++) vao.meshlets[range.firstMeshlet + i].baseVertex = chunk.baseVertex;
+                chunk     = IndexChunk();
+                low       = ~0u;
+                high      = 0;
+                firstPart = (unsigned int)part;
             }
+            if (part == parts) break;
+
+            if (chunk.indexCount == 0) chunk.firstIndex = range.firstIndex + begin;
+            chunk.indexCount += end - begin;
+            low  = std::min(low, partLow);
+            high = std::max(high, partHigh);
         }
+        range.chunkCount = (unsigned int)vao.chunks.size() - range.firstChunk;
+        vao.lods.push_back(range);
     }
 
-
-
     /**
-     * @brief Load and store textures to the given SceneNode
+     * @brief A node for the glTF node and everything below it. The primitives of its mesh are made into nodes the first
+     * time the mesh is seen, and instanced after that.
      *
-     * @param diffuse The filename of the diffuse texture.
-     * @param normal The filename of the normal texture.
-     * @param roughness The filename of the roughness texture.
-     * @param root The root directory of models
+     * @param meshes (Input/Output) The nodes already made for each mesh
      */
-    static void addTextureMaps(
-        SceneNode *node,
-        std::string const &diffuse,
-        std::string const &normal,
-        std::string const &roughness,
-        std::string const &root = "../res/models/")
-    {
-        std::ifstream fdiff((root + diffuse).c_str());
-        if (!fdiff.fail())
-        {
-            node->textures.diffuseID = initTexture(Image(root + diffuse));
-        }
-        else
-        {
-            printf("Could not load texture: %s\n", (root + diffuse).c_str());
-            return;
-        }
-        std::ifstream fnor((root + normal).c_str());
-        if (!fnor.fail())
-        {
-            node->textures.normalID = initTexture(Image((root + normal)));
-        }
-        else
-        {
-            printf("Could not load texture: %s\n", (root + normal).c_str());
-            return;
-        }
-        std::ifstream frough((root + roughness).c_str());
-        if (!frough.fail())
-        {
-            node->textures.roughnessID = initTexture(Image((root + roughness)));
-        }
-        else
+    static SceneNode *importNode(cgltf_node const &gltfNode, AppearanceType appearance, ThreadPool *workers,
+                                 std::unordered_map<cgltf_mesh const *, std::vector<SceneNode *>> &meshes)
+    {
+        SceneNode *node = new SceneNode();
+        cgltf_node_transform_local(&gltfNode, glm::value_ptr(node->localTransform)); // column major, like glm
+
+        if (gltfNode.mesh)
         {
-            printf("Could not load texture: %s\n", (root + roughness).c_str());
-            return;
+            auto found = meshes.find(gltfNode.mesh);
+            if (found == meshes.end())
+            {
+                std::vector<SceneNode *> &primitives = meshes[gltfNode.mesh];
+                for (cgltf_size i = 0; i < gltfNode.mesh->primitives_count; i++)
+                {
+                    Mesh mesh(gltfNode.mesh->primitives[i]);
+                    if (mesh.indices.empty()) continue;
+                    primitives.push_back(fromMesh(mesh, appearance, workers));
+                    node->addChild(primitives.back());
+                }
+            }
+            else
+            {
+                for (SceneNode *primitive : found->second) node->addChild(primitive->instance());
+            }
         }
-        node->textures.hasTextures = true;
+
+        for (cgltf_size i = 0; i < gltfNode.children_count; i++)
+            node->addChild(importNode(*gltfNode.children[i], appearance, workers, meshes));
+        return node;
+    }
+
+    static glm::vec3 safeNormalize(glm::vec3 vector)
+    {
+        float length = glm::length(vector);
+        return 0 < length ? vector / length : glm::vec3(0);
     }
 };
 
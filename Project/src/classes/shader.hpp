@@ -3,26 +3,32 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "utilities/glState.hpp"
+#include "utilities/trace.hpp"
+
 
 // The locations of all uniforms in all shaders
 namespace UNIFORMS
 {
-    const int M = 1;
     const int V = 2;
     const int P = 3;
-    const int N = 4;
+    const int B = 5; // Bounding box transformation, only used by bounds.vert
 
     const int has_textures       = 10;
     const int camera_position    = 11;
     const int sunlight_color     = 12;
     const int sunlight_direction = 13;
+    const int material_layers    = 14;
+    const int has_environment    = 15;
 }
 
 // Texture bindings in fragment shaders
@@ -32,8 +38,22 @@ namespace BINDINGS
     const int diffuse_map   = 1;
     const int normal_map    = 2;
     const int roughness_map = 3;
+    const int environment   = 4;
 }
 
+// Uniform block bindings
+namespace BLOCKS
+{
+    const int object = 0;
+}
+
+// Layout of the "Object" uniform block in main.vert (std140, so the columns of mat3 are padded to vec4)
+struct ObjectBlock
+{
+    glm::mat4 M;    // Model Matrix
+    glm::vec4 N[3]; // Normal Matrix
+};
+
 
 
 class Shader
@@ -53,6 +73,7 @@ public:
            std::string const &fragmentFilename,
            std::string const &root = "../shaders/")
     {
+        TRACE::Scope scope("compile " + vertexFilename + " + " + fragmentFilename, "loading");
         program = glCreateProgram();
 
         attach(root + vertexFilename);
@@ -62,7 +83,7 @@ public:
 
     void activate()
     {
-        glUseProgram(program);
+        GLSTATE::useProgram(program);
     }
 
     GLint getProgram()
@@ -71,18 +92,50 @@ public:
     }
 
     /*
-     * Some more convenience functions so i dont have to think about what gl function and type each uniform is
+     * Some more convenience functions so i dont have to think about what gl function and type each uniform is.
+     * Values are remembered per program, so setting a uniform to the value it already has is skipped.
      */
 
-    void setUniform(unsigned int location, int value) { glUniform1i(location, value); }
-    void setUniform(unsigned int location, bool value) { glUniform1i(location, value); }
-    void setUniform(unsigned int location, float value) { glUniform1f(location, value); }
-    void setUniform(unsigned int location, unsigned int value) { glUniform1i(location, value); }
-    void setUniform(unsigned int location, glm::vec2 value) { glUniform2fv(location, 1, glm::value_ptr(value)); }
-    void setUniform(unsigned int location, glm::vec3 value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
-    void setUniform(unsigned int location, glm::vec4 value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
-    void setUniform(unsigned int location, glm::mat3 value) { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
-    void setUniform(unsigned int location, glm::mat4 value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+    void setUniform(unsigned int location, int value)
+    {
+        if (changed(location, value)) glProgramUniform1i(program, location, value);
+    }
+    void setUniform(unsigned int location, bool value)
+    {
+        if (changed(location, (int)value)) glProgramUniform1i(program, location, value);
+    }
+    void setUniform(unsigned int location, float value)
+    {
+        if (changed(location, value)) glProgramUniform1f(program, location, value);
+    }
+    void setUniform(unsigned int location, unsigned int value)
+    {
+        if (changed(location, (int)value)) glProgramUniform1i(program, location, value);
+    }
+    void setUniform(unsigned int location, glm::vec2 value)
+    {
+        if (changed(location, value)) glProgramUniform2fv(program, location, 1, glm::value_ptr(value));
+    }
+    void setUniform(unsigned int location, glm::vec3 value)
+    {
+        if (changed(location, value)) glProgramUniform3fv(program, location, 1, glm::value_ptr(value));
+    }
+    void setUniform(unsigned int location, glm::vec4 value)
+    {
+        if (changed(location, value)) glProgramUniform4fv(program, location, 1, glm::value_ptr(value));
+    }
+    void setUniform(unsigned int location, glm::ivec3 value)
+    {
+        if (changed(location, value)) glProgramUniform3iv(program, location, 1, glm::value_ptr(value));
+    }
+    void setUniform(unsigned int location, glm::mat3 value)
+    {
+        if (changed(location, value)) glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+    void setUniform(unsigned int location, glm::mat4 value)
+    {
+        if (changed(location, value)) glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, glm::value_ptr(value));
+    }
 
 
 
@@ -94,6 +147,26 @@ private:
     GLint mStatus;
     GLint mLength;
 
+    // Last value set for each uniform location in this program, as raw bytes
+    std::vector<std::vector<unsigned char>> uniformValues;
+
+    /* Remember the value and return true if it is different from the last value set at this location */
+    template <class T>
+    bool changed(unsigned int location, T const &value)
+    {
+        if (uniformValues.size() <= location) uniformValues.resize(location + 1);
+        std::vector<unsigned char> &current = uniformValues[location];
+        if (current.size() == sizeof(T) && memcmp(current.data(), &value, sizeof(T)) == 0)
+        {
+            GLSTATE::countSkipped();
+            return false;
+        }
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+        current.assign(bytes, bytes + sizeof(T));
+        GLSTATE::countIssued();
+        return true;
+    }
+
     /* Helper function for creating shaders */
     GLuint create(std::string const &filename)
     {
@@ -0,0 +1,181 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "sceneNode.hpp"
+#include "utilities/trace.hpp"
+
+
+
+// What the renderer needs to know about the camera
+struct CameraState
+{
+    glm::vec3 position = glm::vec3(0);
+    glm::vec3 front    = glm::vec3(0, 0, -1);
+    glm::vec3 up       = glm::vec3(0, 1, 0);
+    float FOV          = 60;
+};
+
+// Everything that moves in the scene at a single simulation tick
+struct Snapshot
+{
+    double time = 0;               // seconds since the simulation started
+    std::vector<NodeState> nodes;  // in the order of root->getAllChildren()
+    CameraState camera;
+};
+
+
+
+/**
+ * Runs the simulation (movement, animations etc.) at a fixed rate on its own thread.
+ *
+ * After every tick the state is copied into a snapshot, and the two latest snapshots are kept for the renderer. The
+ * renderer draws the scene between those two, so movement looks smooth no matter how the tick rate and frame rate line
+ * up, and a slow frame (like updating all the environment maps) never makes the simulation take a bigger step.
+ *
+ *      ticks:    |----|----|----|----|
+ *      frame:                 ^  drawn here, between the two latest ticks
+ *
+ * Anything that changes the simulated state from another thread (input callbacks) must hold lockState() while doing so.
+ */
+class Simulation
+{
+    typedef std::chrono::steady_clock Clock;
+
+public:
+    /**
+     * @param ticksPerSecond How many times per second update is called
+     * @param update Advances the simulated state by the given number of seconds
+     * @param capture Copies the simulated state into the given snapshot
+     */
+    Simulation(double ticksPerSecond, std::function<void(float)> update, std::function<void(Snapshot &)> capture)
+    {
+        this->tickSeconds = 1.0 / ticksPerSecond;
+        this->update      = update;
+        this->capture     = capture;
+
+        capture(current);
+        previous = current;
+    }
+
+    ~Simulation()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        if (running) return;
+        running = true;
+        thread  = std::thread(&Simulation::run, this);
+    }
+
+    void stop()
+    {
+        running = false;
+        if (thread.joinable()) thread.join();
+    }
+
+    /** Hold the returned lock while changing anything the simulation reads or writes */
+    std::unique_lock<std::mutex> lockState()
+    {
+        return std::unique_lock<std::mutex>(stateMutex);
+    }
+
+    /**
+     * @brief Copies the two latest snapshots, and finds how far between them the current time is.
+     * The renderer lags one tick behind the simulation, so there always is a snapshot on each side of it.
+     *
+     * @return Interpolation factor between previous (0) and current (1)
+     */
+    float getSnapshots(Snapshot &previous, Snapshot &current)
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        previous = this->previous;
+        current  = this->current;
+
+        double renderTime = secondsSinceStart() - tickSeconds;
+        double span       = current.time - previous.time;
+        if (span <= 0) return 1.0f;
+        return (float)std::min(1.0, std::max(0.0, (renderTime - previous.time) / span));
+    }
+
+    unsigned long getTicks()
+    {
+        return ticks;
+    }
+
+
+
+private:
+    // Disable copying and assignment
+    Simulation(Simulation const &) = delete;
+    Simulation &operator=(Simulation const &) = delete;
+
+    double tickSeconds;
+    std::function<void(float)> update;
+    std::function<void(Snapshot &)> capture;
+
+    std::thread thread;
+    std::atomic<bool> running { false };
+    std::atomic<unsigned long> ticks { 0 };
+    Clock::time_point startTime = Clock::now();
+
+    std::mutex stateMutex;
+    std::mutex snapshotMutex;
+    Snapshot previous;
+    Snapshot current;
+    Snapshot next; // only touched by the simulation thread
+
+    double secondsSinceStart()
+    {
+        return std::chrono::duration<double>(Clock::now() - startTime).count();
+    }
+
+    void run()
+    {
+        TRACE::setThreadName("simulation");
+        Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tickSeconds));
+        Clock::time_point deadline = Clock::now();
+        double simulatedTime       = secondsSinceStart();
+
+        while (running)
+        {
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                update((float)tickSeconds);
+                capture(next);
+            }
+            simulatedTime += tickSeconds;
+            next.time = simulatedTime;
+
+            {
+                std::lock_guard<std::mutex> lock(snapshotMutex);
+                std::swap(previous, current);
+                std::swap(current, next);
+            }
+            ticks++;
+
+            // Fixed rate, but if we are far behind (debugger, sleeping laptop) we skip ahead instead of catching up
+            deadline += tick;
+            if (deadline + tick * 10 < Clock::now())
+            {
+                deadline      = Clock::now();
+                simulatedTime = secondsSinceStart();
+            }
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+};
+
+#endif
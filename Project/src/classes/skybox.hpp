@@ -2,12 +2,16 @@
 #define SKYBOX_HPP
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include <glm/glm.hpp>
 #include <stb_image.h>
 
 #include "image.hpp"
 #include "options.hpp"
 #include "shader.hpp"
+#include "utilities/glState.hpp"
 
 
 
@@ -19,9 +23,43 @@ public:
     glm::vec3 sunlightDirection;
     glm::vec3 sunlightColor;
 
+    // One side of the cubemap as it was read from its file
+    struct Face
+    {
+        int width     = 0;
+        int height    = 0;
+        GLenum format = GL_RGBA; // GL_RGB or GL_RGBA, one byte per channel
+        std::vector<unsigned char> pixels;
+    };
+
+
+    /**
+     * @brief A skybox that is just the color of the sunlight, until its faces are uploaded with setFace()
+     *
+     * @param sunlightDirection the direction of the sunlight in this skybox
+     * @param sunlightColor the color of the sunlight in this skybox
+     */
+    Skybox(glm::vec3 sunlightDirection, glm::vec3 sunlightColor)
+    {
+        this->sunlightDirection = sunlightDirection;
+        this->sunlightColor     = sunlightColor;
+
+        // Initialize VAO and VBO
+        unsigned int vbo;
+        glCreateBuffers(1, &vbo);
+        glNamedBufferStorage(vbo, sizeof(vertices), &vertices, 0);
+        glCreateVertexArrays(1, &vaoID);
+        glVertexArrayVertexBuffer(vaoID, 0, vbo, 0, 3 * sizeof(float));
+        glVertexArrayAttribFormat(vaoID, 0, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vaoID, 0, 0);
+        glEnableVertexArrayAttrib(vaoID, 0);
+
+        createTexture(1, 1, GL_RGBA8);
+    }
+
 
     /**
-     * @brief loads a cubemap texture from 6 different images.
+     * @brief The files of the 6 faces of a cubemap.
      *
      * To get such an image you can just find a panorama and use: https://jaxry.github.io/panorama-to-cubemap/
      * which will create the correct faces places horizontally.
@@ -45,18 +83,13 @@ public:
      *      |----|
      *
      * @param name folder name with images
-     * @param extension the extension of all the images (.jpg / .png)
-     * @param sunlightDirection the direction of the sunlight in this skybox
-     * @param sunlightColor the color of the sunlight in this skybox
+     * @param extensions the extension of all the images (.jpg / .png)
      * @param root the root folder where cubemaps are stored
+     * @return The files in the order of the cubemap sides (+X, -X, +Y, -Y, +Z, -Z)
      */
-    Skybox(std::string name,
-           std::string extensions,
-           glm::vec3 sunlightDirection,
-           glm::vec3 sunlightColor,
-           std::string root = "../res/cubemaps/")
+    static std::vector<std::string> getFaceFiles(std::string name, std::string extensions, std::string root = "../res/cubemaps/")
     {
-        std::vector<std::string> faces = {
+        return {
             root + name + "/right" + extensions,  // +X
             root + name + "/left" + extensions,   // -X
             root + name + "/top" + extensions,    // +Y
@@ -64,70 +97,98 @@ public:
             root + name + "/front" + extensions,  // +Z
             root + name + "/back" + extensions,   // -Z
         };
+    }
 
-        // Initialize VAO
-        glGenVertexArrays(1, &vaoID);
-        glBindVertexArray(vaoID);
-        // Intialize VBO
-        unsigned int vbo;
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-        glEnableVertexAttribArray(0);
-        // Create Texture
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-        // Load skybox faces to the texture
-        if (extensions == ".jpg")
+    /**
+     * @brief Reads and decodes a face, without OpenGL so it can be done on any thread
+     *
+     * @return The face, without pixels if it could not be read
+     */
+    static Face readFace(std::string const &filename)
+    {
+        Face face;
+        if (4 <= filename.size() && filename.compare(filename.size() - 4, 4, ".jpg") == 0)
         {
             // Struggling to get .jpg to work properly for some reason with my Image class, so handle it in this nasty way, please ignore
-            int width, height, channels;
-            for (unsigned int i = 0; i < faces.size(); i++)
+            TRACE::Scope scope("decode " + filename, "loading");
+            int channels;
+            unsigned char *data = stbi_load(filename.c_str(), &face.width, &face.height, &channels, 3);
+            if (!data)
             {
-                unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &channels, 0);
-                if (!data) fprintf(stderr, "Failed to load image: %s\n", faces[i].c_str());
-                if (OPTIONS::verbose) printf("Loaded image: %s \tWidth: %d Height: %d Channels: %d\n", faces[i].c_str(), width, height, channels);
-                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-                stbi_image_free(data);
+                fprintf(stderr, "Failed to load image: %s\n", filename.c_str());
+                return Face();
             }
+            if (OPTIONS::verbose) printf("Loaded image: %s \tWidth: %d Height: %d Channels: %d\n", filename.c_str(), face.width, face.height, channels);
+            face.format = GL_RGB;
+            face.pixels.assign(data, data + face.width * face.height * 3);
+            stbi_image_free(data);
         }
         else
         {
             // Ahh much better and easy to read
-            for (unsigned int i = 0; i < faces.size(); i++)
-            {
-                Image image = Image(faces[i]);
-                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
-            }
+            Image image = Image(filename);
+            face.width  = image.width;
+            face.height = image.height;
+            face.format = GL_RGBA;
+            face.pixels.assign((const unsigned char *)image.pixels.data(), (const unsigned char *)(image.pixels.data() + image.pixels.size()));
         }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        return face;
+    }
 
-        this->sunlightDirection = sunlightDirection;
-        this->sunlightColor     = sunlightColor;
+    /**
+     * @brief Uploads a face to the given side. The first face replaces the placeholder with a texture of its size, the
+     * sides that are not uploaded yet stay the color of the sunlight
+     *
+     * @param side The side of the cubemap, in the order of getFaceFiles()
+     */
+    void setFace(unsigned int side, Face const &face)
+    {
+        if (face.pixels.empty()) return;
+        if (!hasFaces)
+        {
+            glDeleteTextures(1, &textureID);
+            GLSTATE::invalidate(); // the old ID might be reused by the new texture
+            createTexture(face.width, face.height, face.format == GL_RGB ? GL_RGB8 : GL_RGBA8);
+            hasFaces = true;
+        }
+        glTextureSubImage3D(textureID, 0, 0, 0, side, face.width, face.height, 1, face.format, GL_UNSIGNED_BYTE, face.pixels.data());
     }
 
 
     /**
-     * Disables the depth mask and draws the skybox, this should therefore be called
-     * before any other geometry as it will overwrite anything further away than a unit cube.
+     * Draws the skybox at maximum depth (the vertex shader sets z = w), this should therefore be called
+     * after all other geometry so that only the pixels that are not covered by anything get shaded.
      */
     void render()
     {
-        glDepthMask(GL_FALSE);
-        glBindVertexArray(vaoID);
-        glBindTextureUnit(BINDINGS::skybox, textureID);
+        GLSTATE::depthMask(GL_FALSE);
+        GLSTATE::depthFunc(GL_LEQUAL);
+        GLSTATE::bindVertexArray(vaoID);
+        GLSTATE::bindTextureUnit(BINDINGS::skybox, textureID);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthMask(GL_TRUE);
+        GLSTATE::depthFunc(GL_LESS);
+        GLSTATE::depthMask(GL_TRUE);
     }
 
 
 
 private:
+    bool hasFaces = false; // whether the texture is the placeholder
+
+    // A cubemap with every side the color of the sunlight
+    void createTexture(int width, int height, GLenum internalFormat)
+    {
+        glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+        glTextureStorage2D(textureID, 1, internalFormat, width, height);
+        glm::vec4 color = glm::vec4(sunlightColor, 1);
+        glClearTexImage(textureID, 0, GL_RGBA, GL_FLOAT, &color);
+        glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+
     float vertices[6 * 6 * 3] = {
         -1.0f, 1.0f, -1.0f,
         -1.0f, -1.0f, -1.0f,
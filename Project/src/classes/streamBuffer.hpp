@@ -0,0 +1,161 @@
+#ifndef STREAM_BUFFER_HPP
+#define STREAM_BUFFER_HPP
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+
+#include <glad/glad.h>
+
+
+
+// A piece of the stream buffer that is valid for the rest of the current frame
+struct StreamAllocation
+{
+    void *data       = nullptr; // CPU pointer to write to (directly visible to the GPU)
+    GLintptr offset  = 0;       // offset in the buffer, used when binding
+    GLsizeiptr size  = 0;
+
+    bool isValid() { return data != nullptr; }
+};
+
+
+
+/**
+ * Persistently mapped buffer for data that changes every frame (transforms, per draw values etc.)
+ *
+ * The buffer is split in one region per frame in flight. Each frame allocates from its own region with a simple bump
+ * allocator, and when the frame is done a fence is placed so the region is not written to again before the GPU has
+ * finished reading it. With three regions the CPU can be two frames ahead of the GPU before it has to wait.
+ *
+ *      |---- frame 0 ----|---- frame 1 ----|---- frame 2 ----|
+ *      | used |  free    | used by GPU     | used by GPU     |
+ *             ^ head
+ */
+class StreamBuffer
+{
+public:
+    unsigned int ID;
+    GLsizeiptr regionSize;
+
+    /**
+     * @param regionSize Number of bytes available for each frame
+     * @param regions Number of frames that can be in flight at the same time
+     */
+    StreamBuffer(GLsizeiptr regionSize, unsigned int regions = 3)
+    {
+        this->regionSize = regionSize;
+        this->regions    = regions;
+        fences           = new GLsync[regions]();
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &ID);
+        glNamedBufferStorage(ID, regionSize * regions, nullptr, flags);
+        mapping = (char *)glMapNamedBufferRange(ID, 0, regionSize * regions, flags);
+
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    }
+
+    ~StreamBuffer()
+    {
+        for (unsigned int i = 0; i < regions; i++)
+            if (fences[i]) glDeleteSync(fences[i]);
+        delete[] fences;
+        glUnmapNamedBuffer(ID);
+        glDeleteBuffers(1, &ID);
+    }
+
+    /** Move to the next region, waiting for the GPU if it is still reading from it */
+    void beginFrame()
+    {
+        region = (region + 1) % regions;
+        head   = 0;
+        full   = false;
+
+        GLsync &fence = fences[region];
+        if (!fence) return;
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+            if (result == GL_WAIT_FAILED) break;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    /** Mark the end of all GPU commands that read from the current region */
+    void endFrame()
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /**
+     * @brief Reserve bytes in the current frame's region, the memory is only valid until the next beginFrame()
+     *
+     * @param size Number of bytes
+     * @param alignment Required alignment of the offset, use getUniformAlignment() for uniform blocks
+     * @return The allocation, which is invalid if the region is full
+     */
+    StreamAllocation allocate(GLsizeiptr size, GLint alignment = 16)
+    {
+        StreamAllocation allocation;
+        GLsizeiptr start = ((head + alignment - 1) / alignment) * alignment;
+        if (regionSize < start + size)
+        {
+            // Only once per frame, every draw after this fails the same way
+            if (!full) fprintf(stderr, "StreamBuffer: Region full, could not allocate %ld bytes (increase OPTIONS::frameDataSize)\n", (long)size);
+            full = true;
+            return allocation;
+        }
+        head = start + size;
+
+        allocation.offset = region * regionSize + start;
+        allocation.data   = mapping + allocation.offset;
+        allocation.size   = size;
+        return allocation;
+    }
+
+    /** Allocate and copy the value into the buffer in one go */
+    template <class T>
+    StreamAllocation upload(const T &value, GLint alignment = 16)
+    {
+        StreamAllocation allocation = allocate(sizeof(T), alignment);
+        if (allocation.isValid()) memcpy(allocation.data, &value, sizeof(T));
+        return allocation;
+    }
+
+    /** Bind the allocation as the uniform block at the given binding */
+    void bindUniformBlock(unsigned int binding, StreamAllocation &allocation)
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, allocation.offset, allocation.size);
+    }
+
+    /** Bind the whole buffer as the source of indirect draws, the offset of the allocation is passed to the draw call */
+    void bindDrawIndirect()
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ID);
+    }
+
+    GLint getUniformAlignment()
+    {
+        return uniformAlignment;
+    }
+
+
+
+private:
+    // Disable copying and assignment
+    StreamBuffer(StreamBuffer const &) = delete;
+    StreamBuffer &operator=(StreamBuffer const &) = delete;
+
+    char *mapping;
+    GLsync *fences;
+    unsigned int regions;
+    unsigned int region = 0;
+    GLsizeiptr head     = 0;
+    bool full           = false; // an allocation in the current region has failed, and was reported
+    GLint uniformAlignment;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utilities/trace.hpp"
+
+
+
+/**
+ * A fixed set of worker threads for splitting CPU work that is done every frame (like culling) into pieces.
+ *
+ * parallelFor() cuts a range into chunks, and the workers and the calling thread take chunks until there are none
+ * left. It returns when every chunk is done, so the function may use anything the caller owns.
+ *
+ *      pool.parallelFor(items.size(), 64, [&](size_t begin, size_t end) {
+ *          for (size_t i = begin; i < end; i++) process(items[i]);
+ *      });
+ */
+class ThreadPool
+{
+public:
+    /** @param threads Number of worker threads, 0 for one less than the number of cores (the caller helps as well) */
+    ThreadPool(unsigned int threads = 0)
+    {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < threads; i++) workers.push_back(std::thread(&ThreadPool::run, this, i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers) worker.join();
+    }
+
+    /**
+     * @brief Calls function(begin, end) for consecutive chunks of [0, count), in parallel, and waits for all of them
+     *
+     * @param chunkSize Number of items per call, big enough that a call is worth more than the cost of handing it out
+     */
+    void parallelFor(size_t count, size_t chunkSize, std::function<void(size_t, size_t)> function)
+    {
+        if (count == 0) return;
+        chunkSize     = std::max(chunkSize, (size_t)1);
+        size_t chunks = (count + chunkSize - 1) / chunkSize;
+
+        // Not worth waking anyone
+        if (workers.empty() || chunks == 1)
+        {
+            for (size_t begin = 0; begin < count; begin += chunkSize) function(begin, std::min(count, begin + chunkSize));
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job             = function;
+            this->count     = count;
+            this->chunkSize = chunkSize;
+            this->chunks    = chunks;
+            nextChunk       = 0;
+            finishedWorkers = 0;
+            generation++;
+        }
+        wake.notify_all();
+        runChunks();
+
+        // Every worker has to be done with this job before the next one may replace it
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&]() { return finishedWorkers == workers.size(); });
+    }
+
+    size_t getThreadCount()
+    {
+        return workers.size() + 1;
+    }
+
+
+
+private:
+    // Disable copying and assignment
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping            = false;
+    unsigned long generation = 0;
+
+    // The current job, only changed while no worker is running it
+    std::function<void(size_t, size_t)> job;
+    size_t count     = 0;
+    size_t chunkSize = 0;
+    size_t chunks    = 0;
+    std::atomic<size_t> nextChunk { 0 };
+    size_t finishedWorkers = 0;
+
+    void runChunks()
+    {
+        for (size_t chunk = nextChunk++; chunk < chunks; chunk = nextChunk++)
+        {
+            size_t begin = chunk * chunkSize;
+            job(begin, std::min(count, begin + chunkSize));
+        }
+    }
+
+    void run(unsigned int index)
+    {
+        TRACE::setThreadName("worker " + std::to_string(index));
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&]() { return stopping || seen != generation; });
+            if (stopping) return;
+            seen = generation;
+
+            lock.unlock();
+            runChunks();
+            lock.lock();
+
+            if (++finishedWorkers == workers.size()) finished.notify_all();
+        }
+    }
+};
+
+#endif
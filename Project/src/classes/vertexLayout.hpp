@@ -0,0 +1,162 @@
+#ifndef VERTEX_LAYOUT_HPP
+#define VERTEX_LAYOUT_HPP
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+
+
+// How OpenGL should read a member of the given type (number of components and component type)
+template <class T>
+struct AttributeFormat;
+
+template <>
+struct AttributeFormat<float>
+{
+    static const GLint size  = 1;
+    static const GLenum type = GL_FLOAT;
+};
+template <>
+struct AttributeFormat<glm::vec2>
+{
+    static const GLint size  = 2;
+    static const GLenum type = GL_FLOAT;
+};
+template <>
+struct AttributeFormat<glm::vec3>
+{
+    static const GLint size  = 3;
+    static const GLenum type = GL_FLOAT;
+};
+template <>
+struct AttributeFormat<glm::vec4>
+{
+    static const GLint size  = 4;
+    static const GLenum type = GL_FLOAT;
+};
+
+// Packed types, OpenGL unpacks them when they are read so the vertex shader still gets floats.
+// Three signed 10 bit components and a signed 2 bit one in 32 bits, read as a vec4 (-1 to 1) when normalized.
+// Plenty for unit vectors like normals and tangents, the last component only holds -1, 0 or 1
+struct PackedSnorm4
+{
+    GLuint bits = 0;
+
+    PackedSnorm4() = default;
+    PackedSnorm4(glm::vec4 value) : bits(glm::packSnorm3x10_1x2(value)) {}
+};
+
+// Two half floats in 32 bits, read as a vec2
+struct PackedHalf2
+{
+    GLuint bits = 0;
+
+    PackedHalf2() = default;
+    PackedHalf2(glm::vec2 value) : bits(glm::packHalf2x16(value)) {}
+};
+
+// Two unsigned 16 bit components in 32 bits, read as a vec2 (0 to 1) when normalized. Steps of 1/65535 over the whole
+// range, finer than half floats everywhere above 1/32, but values outside 0 - 1 are clamped
+struct PackedUnorm2
+{
+    GLuint bits = 0;
+
+    PackedUnorm2() = default;
+    PackedUnorm2(glm::vec2 value) : bits(glm::packUnorm2x16(value)) {}
+};
+
+template <>
+struct AttributeFormat<PackedSnorm4>
+{
+    static const GLint size  = 4;
+    static const GLenum type = GL_INT_2_10_10_10_REV;
+};
+template <>
+struct AttributeFormat<PackedHalf2>
+{
+    static const GLint size  = 2;
+    static const GLenum type = GL_HALF_FLOAT;
+};
+template <>
+struct AttributeFormat<PackedUnorm2>
+{
+    static const GLint size  = 2;
+    static const GLenum type = GL_UNSIGNED_SHORT;
+};
+
+struct VertexAttribute
+{
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+
+
+/**
+ * Describes an interleaved vertex format (one buffer, one stride) from the members of a vertex struct, so the struct
+ * is the only place the format is written down:
+ *
+ *      struct Vertex { glm::vec3 position; glm::vec2 uv; };
+ *      VertexLayout layout = VertexLayout::of<Vertex>().add(0, &Vertex::position).add(1, &Vertex::uv);
+ *      layout.apply(vaoID, 0); // with the vertex buffer bound to binding point 0 of the VAO
+ */
+class VertexLayout
+{
+public:
+    GLsizei stride = 0;
+    std::vector<VertexAttribute> attributes;
+
+    template <class Vertex>
+    static VertexLayout of()
+    {
+        VertexLayout layout;
+        layout.stride = sizeof(Vertex);
+        return layout;
+    }
+
+    /**
+     * @brief Adds a member of the vertex struct as an attribute
+     *
+     * @param location Attribute location in the vertex shader
+     * @param member Pointer to the member, like &Vertex::position
+     * @param normalized Whether integer values are mapped to 0 - 1 (or -1 - 1) when read
+     */
+    template <class Vertex, class T>
+    VertexLayout &add(GLuint location, T Vertex::*member, bool normalized = false)
+    {
+        return add(location, member, AttributeFormat<T>::size, AttributeFormat<T>::type, normalized);
+    }
+
+    /**
+     * @brief Adds a member whose format is only known at runtime, like a 32 bit member that holds one of several packed
+     * types depending on the mesh
+     */
+    template <class Vertex, class T>
+    VertexLayout &add(GLuint location, T Vertex::*member, GLint size, GLenum type, bool normalized)
+    {
+        static const Vertex vertex = Vertex();
+        GLuint offset = GLuint(reinterpret_cast<const char *>(&(vertex.*member)) - reinterpret_cast<const char *>(&vertex));
+        attributes.push_back({ location, size, type, GLboolean(normalized), offset });
+        return *this;
+    }
+
+    /** Sets up the attributes of the VAO to read from the given binding point (DSA, nothing is bound) */
+    void apply(GLuint vaoID, GLuint binding) const
+    {
+        for (VertexAttribute const &attribute : attributes)
+        {
+            glEnableVertexArrayAttrib(vaoID, attribute.location);
+            glVertexArrayAttribFormat(vaoID, attribute.location, attribute.size, attribute.type, attribute.normalized, attribute.offset);
+            glVertexArrayAttribBinding(vaoID, attribute.location, binding);
+        }
+    }
+};
+
+#endif
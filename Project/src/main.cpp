@@ -1,9 +1,14 @@
 #include "options.hpp"
 #include "program.hpp"
 
+#include <cstdlib>
+#include <string>
+
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
 
+#include "utilities/headless.hpp"
+
 // A callback which allows GLFW to report errors whenever they occur
 static void glfwErrorCallback(int error, const char *description)
 {
@@ -90,8 +95,96 @@ GLFWwindow *initialise()
 
 
 
+// Settings given on the command line
+struct CommandLineOptions
+{
+    bool headless          = false;
+    int width              = WINDOW::width;
+    int height             = WINDOW::height;
+    int frames             = 100;
+    bool regression        = false;
+    bool updateRegression  = false;
+    double timingThreshold = OPTIONS::regressionTimingThreshold;
+};
+
+void printUsage(const char *program)
+{
+    printf("Usage: %s [--headless] [--width W] [--height H] [--frames N]\n", program);
+    printf("       %s --regression [--threshold PERCENT] | --update-regression\n", program);
+    printf("  --headless           Render offscreen without a window (needs EGL), then exit\n");
+    printf("  --width              Width of the offscreen framebuffer (default %d)\n", WINDOW::width);
+    printf("  --height             Height of the offscreen framebuffer (default %d)\n", WINDOW::height);
+    printf("  --frames             Number of frames to render headless (default 100)\n");
+    printf("  --regression         Render fixed views headless and compare them to the golden images and timing baseline\n");
+    printf("  --threshold          How much slower than the baseline a view may be, in percent (default %g)\n", OPTIONS::regressionTimingThreshold * 100);
+    printf("  --update-regression  Save the fixed views as the new golden images and timing baseline\n");
+}
+
+CommandLineOptions parseArguments(int argc, const char *argb[])
+{
+    CommandLineOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argb[i];
+        bool hasValue        = i + 1 < argc;
+        if (argument == "--headless")
+            options.headless = true;
+        else if (argument == "--width" && hasValue)
+            options.width = std::atoi(argb[++i]);
+        else if (argument == "--height" && hasValue)
+            options.height = std::atoi(argb[++i]);
+        else if (argument == "--frames" && hasValue)
+            options.frames = std::atoi(argb[++i]);
+        else if (argument == "--regression")
+            options.regression = true;
+        else if (argument == "--update-regression")
+            options.updateRegression = true;
+        else if (argument == "--threshold" && hasValue)
+            options.timingThreshold = std::atof(argb[++i]) / 100.0;
+        else
+        {
+            printUsage(argb[0]);
+            exit(argument == "--help" ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (options.width <= 0 || options.height <= 0 || options.frames < 0)
+    {
+        fprintf(stderr, "Width, height and frames must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+    return options;
+}
+
+
+
 int main(int argc, const char *argb[])
 {
+    CommandLineOptions options = parseArguments(argc, argb);
+
+    if (options.regression || options.updateRegression)
+    {
+        if (!HEADLESS::createContext())
+        {
+            HEADLESS::destroyContext();
+            return EXIT_FAILURE;
+        }
+        bool passed = runRegression(options.updateRegression, options.timingThreshold);
+        HEADLESS::destroyContext();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (options.headless)
+    {
+        if (!HEADLESS::createContext())
+        {
+            HEADLESS::destroyContext();
+            return EXIT_FAILURE;
+        }
+        runHeadless(options.width, options.height, options.frames);
+        HEADLESS::destroyContext();
+        return EXIT_SUCCESS;
+    }
+
     // Initialise window using GLFW
     GLFWwindow *window = initialise();
 
@@ -0,0 +1,292 @@
+#ifndef MATERIAL_MANAGER_HPP
+#define MATERIAL_MANAGER_HPP
+#pragma once
+
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "classes/assetLoader.hpp"
+#include "classes/image.hpp"
+#include "classes/shader.hpp"
+#include "options.hpp"
+#include "utilities/glState.hpp"
+#include "utilities/wrappers.hpp"
+
+
+
+// Where a single texture lives, which texture array and which layer in that array
+struct TextureLayer
+{
+    int arrayIndex = -1;
+    int layer      = -1;
+};
+
+// The three texture maps im using for a material
+struct Material
+{
+    TextureLayer diffuse;
+    TextureLayer normal;
+    TextureLayer roughness;
+};
+
+
+
+/**
+ * Keeps every material texture in GL_TEXTURE_2D_ARRAYs grouped by size, so a material is just a set of layer indices.
+ *
+ * All textures of the same size share one array, which means that switching between materials of the same size does
+ * not require any new texture binds, only a new uniform value. A texture of a new size automatically gets its own array,
+ * so textures that cant be grouped together still work, they just cost a bind when switching.
+ */
+class MaterialManager
+{
+private:
+    struct TextureArray
+    {
+        unsigned int ID;
+        int width;
+        int height;
+        int levels;
+        int layers;
+    };
+
+    std::vector<TextureArray> arrays;
+    std::vector<Material> materials;
+    Material placeholder; // in its own 1x1 array, created the first time a material is loaded in the background
+
+public:
+    MaterialManager() { }
+
+    /**
+     * @brief Loads the three maps and places them in a texture array of matching size
+     *
+     * @param diffuse The filename of the diffuse texture.
+     * @param normal The filename of the normal texture.
+     * @param roughness The filename of the roughness texture.
+     * @param root The root directory of models
+     * @return The material ID, or -1 if any of the textures could not be loaded
+     */
+    int addMaterial(std::string const &diffuse,
+                    std::string const &normal,
+                    std::string const &roughness,
+                    std::string const &root = "../res/models/")
+    {
+        if (!exists({ diffuse, normal, roughness }, root)) return -1;
+
+        Image images[3] = { Image(root + diffuse), Image(root + normal), Image(root + roughness) };
+
+        std::vector<TextureLayer> layers = reserveLayers({ glm::ivec2(images[0].width, images[0].height),
+                                                           glm::ivec2(images[1].width, images[1].height),
+                                                           glm::ivec2(images[2].width, images[2].height) });
+        for (int i = 0; i < 3; i++) uploadLayer(layers[i], images[i]);
+
+        Material material;
+        material.diffuse   = layers[0];
+        material.normal    = layers[1];
+        material.roughness = layers[2];
+
+        materials.push_back(material);
+        return (int)materials.size() - 1;
+    }
+
+    /**
+     * @brief Same as addMaterial(), but the textures are read by the loader in the background. The material can be used
+     * right away, each map is a neutral placeholder (grey, flat and a bit rough) until its texture is uploaded.
+     *
+     * @param loader Reads the textures, they are added when the loader uploads them
+     * @return The material ID, or -1 if any of the textures do not exist
+     */
+    int loadMaterial(std::string const &diffuse,
+                     std::string const &normal,
+                     std::string const &roughness,
+                     AssetLoader *loader,
+                     std::string const &root = "../res/models/")
+    {
+        if (!exists({ diffuse, normal, roughness }, root)) return -1;
+
+        // The layers are made here from the sizes in the file headers, so an upload only fills in its own layer
+        std::string filenames[3] = { root + diffuse, root + normal, root + roughness };
+        std::vector<glm::ivec2> sizes;
+        for (std::string const &filename : filenames)
+        {
+            int width, height, channels;
+            if (!STB::info(filename.c_str(), &width, &height, &channels))
+            {
+                printf("Could not read texture: %s\n", filename.c_str());
+                return -1;
+            }
+            sizes.push_back(glm::ivec2(width, height));
+        }
+        std::vector<TextureLayer> layers = reserveLayers(sizes);
+
+        materials.push_back(getPlaceholder());
+        int materialID = (int)materials.size() - 1;
+
+        TextureLayer Material::*maps[3] = { &Material::diffuse, &Material::normal, &Material::roughness };
+        for (int i = 0; i < 3; i++)
+        {
+            std::string filename        = filenames[i];
+            TextureLayer Material::*map = maps[i];
+            TextureLayer layer          = layers[i];
+            loader->load<Image>(
+                filename, [filename]() { return Image(filename); },
+                [this, materialID, map, layer](Image &image) {
+                    uploadLayer(layer, image);
+                    materials[materialID].*map = layer;
+                });
+        }
+        return materialID;
+    }
+
+
+
+    /**
+     * @brief Makes the material available to the shader, the state cache skips binding arrays that are already bound
+     *
+     * @param materialID The material to use, -1 means no material (nothing is bound)
+     * @param shader The shader that is about to be used
+     */
+    void bind(int materialID, Shader *shader)
+    {
+        if (materialID < 0 || (int)materials.size() <= materialID) return;
+        Material &material = materials[materialID];
+
+        GLSTATE::bindTextureUnit(BINDINGS::diffuse_map, arrays[material.diffuse.arrayIndex].ID);
+        GLSTATE::bindTextureUnit(BINDINGS::normal_map, arrays[material.normal.arrayIndex].ID);
+        GLSTATE::bindTextureUnit(BINDINGS::roughness_map, arrays[material.roughness.arrayIndex].ID);
+
+        glm::ivec3 layers = glm::ivec3(material.diffuse.layer, material.normal.layer, material.roughness.layer);
+        shader->setUniform(UNIFORMS::material_layers, layers);
+    }
+
+
+
+private:
+    bool exists(std::vector<std::string> const &filenames, std::string const &root)
+    {
+        for (std::string const &filename : filenames)
+        {
+            std::ifstream fd((root + filename).c_str());
+            if (fd.fail())
+            {
+                printf("Could not load texture: %s\n", (root + filename).c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Material getPlaceholder()
+    {
+        if (placeholder.diffuse.arrayIndex != -1) return placeholder;
+
+        // Grey, a normal pointing straight out, and the roughness the shader uses without textures (0.4)
+        const unsigned char texels[3][4] = { { 128, 128, 128, 255 }, { 128, 128, 255, 255 }, { 102, 102, 102, 255 } };
+        arrays.push_back(createArray(1, 1, 3));
+        int arrayIndex = (int)arrays.size() - 1;
+        glTextureSubImage3D(arrays[arrayIndex].ID, 0, 0, 0, 0, 1, 1, 3, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+
+        placeholder.diffuse   = { arrayIndex, 0 };
+        placeholder.normal    = { arrayIndex, 1 };
+        placeholder.roughness = { arrayIndex, 2 };
+        return placeholder;
+    }
+
+    /**
+     * @brief Adds a layer for each size to the texture array of that size. Every array is grown (or created) once, no
+     * matter how many layers it gets, and the new layers are empty until uploadLayer()
+     */
+    std::vector<TextureLayer> reserveLayers(std::vector<glm::ivec2> const &sizes)
+    {
+        std::vector<TextureLayer> locations(sizes.size());
+        std::vector<int> added(arrays.size(), 0);
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            for (unsigned int a = 0; a < arrays.size(); a++)
+            {
+                if (arrays[a].width == sizes[i].x && arrays[a].height == sizes[i].y) locations[i].arrayIndex = a;
+            }
+            if (locations[i].arrayIndex == -1)
+            {
+                // Created by growArray() below, with all its layers at once
+                TextureArray array = { 0, sizes[i].x, sizes[i].y, levelCount(sizes[i].x, sizes[i].y), 0 };
+                arrays.push_back(array);
+                added.push_back(0);
+                locations[i].arrayIndex = (int)arrays.size() - 1;
+            }
+            locations[i].layer = arrays[locations[i].arrayIndex].layers + added[locations[i].arrayIndex]++;
+        }
+        for (unsigned int a = 0; a < arrays.size(); a++)
+        {
+            if (0 < added[a]) growArray(a, added[a]);
+        }
+        return locations;
+    }
+
+    /** @brief Fills the layer with the image and makes its mipmaps, the other layers of the array are left as they are */
+    void uploadLayer(TextureLayer location, Image const &image)
+    {
+        TextureArray &array = arrays[location.arrayIndex];
+        if (array.width != image.width || array.height != image.height)
+        {
+            fprintf(stderr, "Texture is %dx%d, but its layer is %dx%d\n", image.width, image.height, array.width, array.height);
+            return;
+        }
+        glTextureSubImage3D(array.ID, 0, 0, 0, location.layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+
+        // A view of just this layer, so only its mipmaps are made
+        GLuint view;
+        glGenTextures(1, &view);
+        glTextureView(view, GL_TEXTURE_2D, array.ID, GL_RGBA8, 0, array.levels, location.layer, 1);
+        glGenerateTextureMipmap(view);
+        glDeleteTextures(1, &view);
+    }
+
+    static int levelCount(int width, int height)
+    {
+        return (int)std::floor(std::log2(std::max(width, height))) + 1;
+    }
+
+    TextureArray createArray(int width, int height, int layers)
+    {
+        TextureArray array;
+        array.width  = width;
+        array.height = height;
+        array.layers = layers;
+        array.levels = levelCount(width, height);
+
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &array.ID);
+        glTextureStorage3D(array.ID, array.levels, GL_RGBA8, width, height, layers);
+        glTextureParameteri(array.ID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(array.ID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return array;
+    }
+
+    // Texture storage is immutable, so new layers mean a new array with the old layers copied over
+    void growArray(int arrayIndex, int layers)
+    {
+        TextureArray &old   = arrays[arrayIndex];
+        TextureArray larger = createArray(old.width, old.height, old.layers + layers);
+        if (0 < old.layers)
+        {
+            for (int level = 0; level < old.levels; level++)
+            {
+                int width  = std::max(1, old.width >> level);
+                int height = std::max(1, old.height >> level);
+                glCopyImageSubData(old.ID, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                                   larger.ID, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                                   width, height, old.layers);
+            }
+            glDeleteTextures(1, &old.ID);
+            GLSTATE::invalidate(); // the old ID might be reused by the next texture
+        }
+        arrays[arrayIndex] = larger;
+    }
+};
+
+#endif
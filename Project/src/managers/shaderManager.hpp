@@ -16,6 +16,7 @@ public:
     Shader *reflectionShader;
     Shader *refractionShader;
     Shader *sunlightShader;
+    Shader *depthShader;
 
 
     ShaderManager()
@@ -23,6 +24,7 @@ public:
         reflectionShader = new Shader("main.vert", "reflective.frag");
         refractionShader = new Shader("main.vert", "refractive.frag");
         sunlightShader   = new Shader("main.vert", "sunlight.frag");
+        depthShader      = new Shader("main.vert", "depth.frag");
     }
 
     /**
@@ -37,6 +39,12 @@ public:
         if (node->appearance == SUNLIT) return sunlightShader;
         return nullptr;
     }
+
+    /** Nodes that are expensive to shade, these are worth rendering in a depth pre-pass to avoid shading hidden fragments */
+    bool isExpensive(SceneNode *node)
+    {
+        return node->appearance == REFLECTIVE || node->appearance == REFRACTIVE || node->materialID != -1;
+    }
 };
 
 #endif
\ No newline at end of file
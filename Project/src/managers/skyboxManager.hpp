@@ -3,6 +3,10 @@
 #pragma once
 
 
+#include <string>
+#include <vector>
+
+#include "classes/assetLoader.hpp"
 #include "classes/shader.hpp"
 #include "classes/skybox.hpp"
 #include "options.hpp"
@@ -17,36 +21,40 @@ private:
     Shader *skyboxShader;
 
 public:
-    SkyboxManager()
+    /**
+     * @brief Creates the skyboxes, their faces are read by the loader. Each skybox is the color of its sunlight until
+     * its faces are uploaded
+     */
+    SkyboxManager(AssetLoader *loader)
     {
         skyboxShader      = new Shader("skybox.vert", "skybox.frag");
         activeSkyboxIndex = 0;
 
-        skyboxes.push_back(Skybox(
-            "mountain", ".png",                       // Images
-            glm::vec3(0.529871, -0.340380, 0.776775), // Sunlight Direction
-            glm::vec3(0.98, 0.97, 0.88)               // Sunlight Color
-            ));
+        addSkybox(loader,
+                  "mountain", ".png",                       // Images
+                  glm::vec3(0.529871, -0.340380, 0.776775), // Sunlight Direction
+                  glm::vec3(0.98, 0.97, 0.88)               // Sunlight Color
+        );
 
         if (OPTIONS::mode == OPTIONS::DEBUG) return; // Dont load the other skyboxes in debug mode
 
-        skyboxes.push_back(Skybox(
-            "kiara_dawn", ".png",                     // Images
-            glm::vec3(0.811961, -0.101056, 0.574898), // Sunlight Direction
-            glm::vec3(156, 121, 131) / 255.0f         // Sunlight Color
-            ));
-
-        skyboxes.push_back(Skybox(
-            "forest", ".png",                         // Images
-            glm::vec3(0.539989, -0.414694, 0.732421), // Sunlight Direction
-            glm::vec3(1, 1, 1)                        // Sunlight Color
-            ));
-
-        skyboxes.push_back(Skybox(
-            "lake", ".jpg",                           // Images
-            glm::vec3(0.422755, -0.338738, 0.840556), // Sunlight Direction
-            glm::vec3(0.98, 0.96, 1)                  // Sunlight Color
-            ));
+        addSkybox(loader,
+                  "kiara_dawn", ".png",                     // Images
+                  glm::vec3(0.811961, -0.101056, 0.574898), // Sunlight Direction
+                  glm::vec3(156, 121, 131) / 255.0f         // Sunlight Color
+        );
+
+        addSkybox(loader,
+                  "forest", ".png",                         // Images
+                  glm::vec3(0.539989, -0.414694, 0.732421), // Sunlight Direction
+                  glm::vec3(1, 1, 1)                        // Sunlight Color
+        );
+
+        addSkybox(loader,
+                  "lake", ".jpg",                           // Images
+                  glm::vec3(0.422755, -0.338738, 0.840556), // Sunlight Direction
+                  glm::vec3(0.98, 0.96, 1)                  // Sunlight Color
+        );
     }
 
 
@@ -66,13 +74,26 @@ public:
         return skyboxes[activeSkyboxIndex].textureID;
     }
 
+    /** Bind the current skybox texture, so nodes can sample it before the skybox itself is drawn */
+    void bind()
+    {
+        GLSTATE::bindTextureUnit(BINDINGS::skybox, getTextureID());
+    }
+
     void swapSkybox()
     {
         activeSkyboxIndex = (activeSkyboxIndex + 1) % skyboxes.size();
     }
 
+    // Select the skybox by the order they were loaded in (wraps around if fewer are loaded)
+    void setSkybox(int index)
+    {
+        activeSkyboxIndex = index % skyboxes.size();
+    }
+
     /**
-     * @brief Renders the current skybox using the given view and projection matrices
+     * @brief Renders the current skybox using the given view and projection matrices,
+     * call this after all other geometry in the pass
      *
      * @param view View Matrix
      * @param projection Projection Matrix
@@ -84,6 +105,24 @@ public:
         skyboxShader->setUniform(UNIFORMS::P, projection);
         skyboxes[activeSkyboxIndex].render();
     }
+
+
+
+private:
+    // Every face is read on its own, so the faces of one skybox are read in parallel
+    void addSkybox(AssetLoader *loader, std::string const &name, std::string const &extension, glm::vec3 sunlightDirection, glm::vec3 sunlightColor)
+    {
+        skyboxes.push_back(Skybox(sunlightDirection, sunlightColor));
+        size_t index                   = skyboxes.size() - 1;
+        std::vector<std::string> files = Skybox::getFaceFiles(name, extension);
+        for (unsigned int side = 0; side < files.size(); side++)
+        {
+            std::string filename = files[side];
+            loader->load<Skybox::Face>(
+                filename, [filename]() { return Skybox::readFace(filename); },
+                [this, index, side](Skybox::Face &face) { skyboxes[index].setFace(side, face); });
+        }
+    }
 };
 
 #endif
\ No newline at end of file
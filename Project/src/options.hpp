@@ -15,6 +15,15 @@ namespace WINDOW
 
 
 
+enum PacingMode
+{
+    UNLIMITED, // no waiting, frames are presented as fast as possible
+    FIXED,     // hold the target frame rate
+    ADAPTIVE,  // hold the target frame rate, or the highest fraction of it (1/2, 1/3, ...) the scene can keep up with
+};
+
+
+
 namespace OPTIONS
 {
     enum MODE
@@ -27,14 +36,49 @@ namespace OPTIONS
     const MODE mode    = DEMO;
     const bool verbose = true; // false = only print errors
 
-    const bool limitFPS = false;
-    const int fpsLimit  = 60;
+    const PacingMode pacing = UNLIMITED; // FIXED holds fpsLimit, ADAPTIVE drops to 1/2, 1/3... of it when the scene is too heavy
+    const int fpsLimit      = 60;
+
+    const double simulationRate = 120; // updates per second, independent of the frame rate
 
     const float cameraFOV         = 60;
     const float nearClippingPlane = 0.01f;
     const float farClippingPlane  = 300.0f;
 
+    const bool depthPrePass     = true; // lay down depth for expensive nodes first, so hidden fragments are never shaded
+    const bool occlusionCulling = true; // skip nodes whose bounding box is hidden behind what has already been drawn
+    const bool optimizeMeshes   = true; // reorder triangles and vertices after loading, for the vertex cache, overdraw and fetch
+    const bool meshletCulling   = true; // split meshes into clusters, and skip those outside the view or facing away from it
+    const int workerThreads     = 0;    // threads that help with culling, 0 = one less than the number of cores
+    const bool meshCache        = true; // save what is made from each model in a .meshcache file, and map that on later runs
+    const int loaderThreads     = 0;    // threads that read and decode models and textures in the background, 0 = one per core
+    const double uploadBudget   = 2.0;  // milliseconds per frame spent uploading assets that are done loading (at least one is)
+
+    const int lodLevels            = 5;    // simplified versions of each mesh, with half the triangles of the one before (0 = off)
+    const float lodPixelError      = 1.0f; // draw the coarsest level that is at most this many pixels off on screen
+    const float lodProbePixelError = 4.0f; // same for environment maps, small details are lost in the reflection anyway
+
     const int environmentBufferResolution = 2048; // Can also be adjusted with arrow keys
+
+    const int frameDataSize = 1 << 22; // bytes of per frame GPU data (transforms, meshlet draws etc.) available each frame
+
+    const bool profiler               = true;          // measure CPU and GPU time of each pass (print with O)
+    const int profilerHistory         = 600;           // number of frames kept
+    const std::string profilerCSVFile = "";            // written when the program exits if set, e.g. "profile.csv"
+
+    const bool tracing             = false;        // record a timeline of what each thread does (save with J)
+    const int traceEventsPerThread = 1 << 16;      // newest events kept per thread
+    const std::string traceFile    = "";           // written when the program exits if set, e.g. "trace.json"
+
+    // Regression test (--regression), renders fixed views headless and compares them to the files in regressionDirectory
+    const std::string regressionDirectory  = "../res/regression/";
+    const int regressionWidth              = 640;
+    const int regressionHeight             = 360;
+    const int regressionWarmupFrames       = 5;     // lets the reflections of reflections settle before measuring
+    const int regressionFrames             = 20;    // timed frames per view, the median is compared
+    const int regressionPixelTolerance     = 8;     // a pixel channel may differ this much before the pixel counts as changed
+    const double regressionDifferingPixels = 0.001; // fraction of changed pixels allowed
+    const double regressionTimingThreshold = 0.10;  // fail if a view is this much slower than the baseline (0.10 = 10%)
 }
 
 #endif
\ No newline at end of file
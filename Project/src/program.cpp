@@ -1,46 +1,277 @@
 #include "program.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <vector>
+
 #include <glad/glad.h>
 
+#include "classes/framebuffer.hpp"
+#include "classes/image.hpp"
+#include "classes/simulation.hpp"
 #include "scene.hpp"
+#include "utilities/glState.hpp"
+#include "utilities/profiler.hpp"
+#include "utilities/regression.hpp"
+#include "utilities/trace.hpp"
 
-std::chrono::steady_clock::time_point previousFrameTime = std::chrono::steady_clock::now();
+FramePacer *framePacer;
+Simulation *simulation;
 
 
 
-void runProgram(GLFWwindow *window)
+/** Configure miscellaneous OpenGL settings, the same for the window and headless */
+void configureOpenGL()
 {
-    // Configure miscellaneous OpenGL settings
     glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glEnable(GL_CULL_FACE);
+    GLSTATE::depthFunc(GL_LESS);
+    GLSTATE::cullFace(GL_TRUE);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Set default colour after clearing the colour buffer
     glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
+}
+
+
+
+/** Print and save what the profiler and trace recorded, called at exit */
+void writeProfile()
+{
+    if (OPTIONS::tracing && !OPTIONS::traceFile.empty() && TRACE::write(OPTIONS::traceFile))
+        if (OPTIONS::verbose) printf("Wrote trace to %s\n", OPTIONS::traceFile.c_str());
+
+    if (!OPTIONS::profiler) return;
+    if (OPTIONS::verbose) PROFILER::printStatistics();
+    if (!OPTIONS::profilerCSVFile.empty() && PROFILER::writeCSV(OPTIONS::profilerCSVFile))
+        if (OPTIONS::verbose) printf("Wrote profile to %s\n", OPTIONS::profilerCSVFile.c_str());
+}
+
+
+
+void runProgram(GLFWwindow *window)
+{
+    TRACE::setThreadName("main");
+    std::unique_ptr<TRACE::Scope> programScope(new TRACE::Scope("runProgram", "program"));
+    configureOpenGL();
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    Framebuffer::setWindowSize(width, height);
     // Place cursor in 0, 0  so deltaX and deltaY are 0 first frame
     glfwSetCursorPos(window, 0, 0);
 
     if (OPTIONS::verbose) printf("Initializing Scene\n");
     initScene(window);
+    framePacer = new FramePacer(OPTIONS::pacing, OPTIONS::fpsLimit);
+
+    // The state of the scene (positions, rotations, cameramovement etc.) is updated on its own thread
+    simulation = new Simulation(OPTIONS::simulationRate, updateState, captureState);
+    simulation->start();
+    Snapshot previous, current;
 
     // Rendering Loop
     while (!glfwWindowShouldClose(window))
     {
+        PROFILER::beginFrame();
+        TRACE::Scope frameScope("frame", "frame");
         // keep cursor hidden and active
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-        // Update state of entire scene (positions, rotations, cameramovement etc.)
-        updateState(getSecondsSince(&previousFrameTime));
+        // Place everything where it is at this point in time (between the two latest simulation ticks)
+        float alpha = simulation->getSnapshots(previous, current);
+        applySnapshots(previous, current, alpha);
         // Perform a full render pass on the scene
         renderFrame();
 
-        // Handle events (keyboard/mouse input, window resizing etc.)
-        glfwPollEvents();
+        // Handle events (keyboard/mouse input, window resizing etc.), the callbacks change the simulated state
+        {
+            std::unique_lock<std::mutex> lock = simulation->lockState();
+            glfwPollEvents();
+        }
 
         // Flip buffers
         glfwSwapBuffers(window); // ! Crashes here when i tried on a different computer
+        PROFILER::endFrame();
+        framePacer->nextFrame();
     }
+    simulation->stop();
+    programScope.reset(); // end the event before the trace is written
     if (OPTIONS::verbose) printf("Window Was Closed\n");
+    if (OPTIONS::verbose) printf("Simulated %lu ticks\n", simulation->getTicks());
+    if (OPTIONS::verbose) GLSTATE::printStatistics();
+    if (OPTIONS::verbose) framePacer->printStatistics();
+    writeProfile();
+}
+
+
+
+/**
+ * @brief Renders the given number of frames into an offscreen framebuffer and returns, without any window or input.
+ * The simulation is stepped once per frame on this thread (one frame at the target FPS), so every run is the same.
+ *
+ * @param width Width of the offscreen framebuffer
+ * @param height Height of the offscreen framebuffer
+ * @param frames Number of frames to render
+ */
+void runHeadless(int width, int height, int frames)
+{
+    TRACE::setThreadName("main");
+    std::unique_ptr<TRACE::Scope> programScope(new TRACE::Scope("runHeadless", "program"));
+    configureOpenGL();
+    Framebuffer::setOffscreen(new Framebuffer(width, height));
+
+    if (OPTIONS::verbose) printf("Initializing Scene\n");
+    initScene(nullptr);
+    framePacer = new FramePacer(UNLIMITED, OPTIONS::fpsLimit);
+
+    Snapshot snapshot;
+    float deltaTime = 1.0f / OPTIONS::fpsLimit;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        PROFILER::beginFrame();
+        TRACE::Scope frameScope("frame", "frame");
+        updateState(deltaTime);
+        captureState(snapshot);
+        applySnapshots(snapshot, snapshot, 1.0f);
+        renderFrame();
+
+        // There is no swap to wait for, so wait for the GPU here to measure the time each frame actually takes
+        glFinish();
+        PROFILER::endFrame();
+        framePacer->nextFrame();
+    }
+    programScope.reset(); // end the event before the trace is written
+    if (OPTIONS::verbose) printf("Rendered %d frames (%dx%d)\n", frames, width, height);
+    if (OPTIONS::verbose) GLSTATE::printStatistics();
+    if (OPTIONS::verbose) framePacer->printStatistics();
+    writeProfile();
+}
+
+
+
+/** Reads what was rendered to the offscreen framebuffer, as an image with the top row first (like image files) */
+Image readOffscreen()
+{
+    Image image;
+    image.width  = Framebuffer::getScreenWidth();
+    image.height = Framebuffer::getScreenHeight();
+    image.pixels.resize(image.width * image.height);
+    GLSTATE::bindFramebuffer(Framebuffer::getOffscreen()->ID);
+    glReadPixels(0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+    image.flipY();
+    return image;
+}
+
+/** Saves the image as a PNG, Image::write flips it back and frees the copy */
+void writeImage(Image &image, const std::string &filename, const std::string &root)
+{
+    image.flipY();
+    void *copy = malloc(image.pixels.size() * sizeof(Pixel));
+    memcpy(copy, image.pixels.data(), image.pixels.size() * sizeof(Pixel));
+    Image::write(filename, image.width, image.height, copy, root);
+    image.flipY();
+}
+
+/**
+ * @brief Renders each of the fixed views headless, and compares the image with the golden image and the median frame
+ * time with the baseline in OPTIONS::regressionDirectory. A view that does not match is saved as regression_<name>.png
+ * in the working directory so it can be looked at.
+ *
+ * Timings are only comparable on the same machine and driver (the baseline is meant for Mesa llvmpipe on the test
+ * machine), so update the baseline whenever either changes.
+ *
+ * @param update Save the rendered images and timings as the new golden images and baseline instead of comparing
+ * @param timingThreshold How much slower than the baseline a view may be (0.1 = 10%)
+ * @return true if every view matched (or the files were updated)
+ */
+bool runRegression(bool update, double timingThreshold)
+{
+    TRACE::setThreadName("main");
+    configureOpenGL();
+    Framebuffer::setOffscreen(new Framebuffer(OPTIONS::regressionWidth, OPTIONS::regressionHeight));
+    initScene(nullptr);
+
+    std::string baselineFile               = OPTIONS::regressionDirectory + "baseline.txt";
+    std::map<std::string, double> baseline = REGRESSION::readBaseline(baselineFile);
+    std::map<std::string, double> timings;
+    bool passed = true;
+
+    printf("%-10s %10s %10s %8s %10s %10s %8s  %s\n", "view", "ms", "baseline", "change", "changed px", "mean err", "psnr", "result");
+    for (FixedView const &view : getFixedViews())
+    {
+        TRACE::Scope viewScope("view " + view.name, "regression");
+        setFixedView(view);
+        Snapshot snapshot;
+        captureState(snapshot);
+        applySnapshots(snapshot, snapshot, 1.0f);
+
+        // Every frame renders the exact same thing, the first few are not timed while the reflections settle
+        std::vector<double> frameTimes;
+        for (int frame = 0; frame < OPTIONS::regressionWarmupFrames + OPTIONS::regressionFrames; frame++)
+        {
+            PROFILER::beginFrame();
+            auto start = std::chrono::steady_clock::now();
+            renderFrame();
+            glFinish();
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (OPTIONS::regressionWarmupFrames <= frame) frameTimes.push_back(milliseconds);
+            PROFILER::endFrame();
+        }
+        std::sort(frameTimes.begin(), frameTimes.end());
+        double median      = frameTimes.empty() ? 0 : frameTimes[frameTimes.size() / 2];
+        timings[view.name] = median;
+        Image rendered     = readOffscreen();
+        std::string golden = view.name + ".png";
+
+        if (update)
+        {
+            writeImage(rendered, golden, OPTIONS::regressionDirectory);
+            printf("%-10s %10.2f %10s %8s %10s %10s %8s  %s\n", view.name.c_str(), median, "-", "-", "-", "-", "-", "updated");
+            continue;
+        }
+
+        // Compare the image
+        std::ifstream goldenFile(OPTIONS::regressionDirectory + golden);
+        ImageDifference difference;
+        if (goldenFile.good()) difference = REGRESSION::compareImages(Image(OPTIONS::regressionDirectory + golden), rendered, OPTIONS::regressionPixelTolerance);
+        bool imagePassed = difference.sameSize && difference.differingPixels <= OPTIONS::regressionDifferingPixels;
+
+        // Compare the timing
+        bool hasBaseline  = baseline.count(view.name) != 0;
+        double change     = hasBaseline ? median / baseline[view.name] - 1.0 : 0.0;
+        bool timingPassed = !hasBaseline || change <= timingThreshold;
+
+        std::string result;
+        if (!goldenFile.good())
+            result = "no golden image";
+        else if (!difference.sameSize)
+            result = "size differs from golden image";
+        else if (!imagePassed)
+            result = "image differs";
+        if (!timingPassed) result += std::string(result.empty() ? "" : ", ") + "slower than baseline";
+        if (result.empty()) result = hasBaseline ? "ok" : "ok (no timing baseline)";
+
+        char baselineText[16] = "-", changeText[16] = "-";
+        if (hasBaseline) snprintf(baselineText, sizeof(baselineText), "%.2f", baseline[view.name]);
+        if (hasBaseline) snprintf(changeText, sizeof(changeText), "%+.1f%%", change * 100);
+        printf("%-10s %10.2f %10s %8s %9.3f%% %10.3f %8.1f  %s\n", view.name.c_str(), median, baselineText, changeText,
+               difference.differingPixels * 100, difference.meanError, difference.psnr, result.c_str());
+
+        if (!imagePassed) writeImage(rendered, "regression_" + view.name + ".png", "");
+        passed = passed && imagePassed && timingPassed;
+    }
+
+    if (update)
+    {
+        passed = REGRESSION::writeBaseline(baselineFile, timings);
+        if (passed) printf("Updated golden images and %s\n", baselineFile.c_str());
+        return passed;
+    }
+    printf(passed ? "Regression test passed\n" : "Regression test FAILED\n");
+    return passed;
 }
@@ -1,19 +1,33 @@
 #include "scene.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <string>
+
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "classes/assetLoader.hpp"
 #include "classes/camera.hpp"
 #include "classes/framebuffer.hpp"
 #include "classes/image.hpp"
 #include "classes/keyboard.hpp"
 #include "classes/mesh.hpp"
+#include "classes/occlusionCuller.hpp"
 #include "classes/sceneNode.hpp"
 #include "classes/shader.hpp"
+#include "classes/simulation.hpp"
+#include "classes/streamBuffer.hpp"
+#include "classes/threadPool.hpp"
+#include "managers/materialManager.hpp"
 #include "managers/shaderManager.hpp"
 #include "managers/skyboxManager.hpp"
 #include "options.hpp"
+#include "program.hpp"
+#include "utilities/glState.hpp"
+#include "utilities/profiler.hpp"
+#include "utilities/trace.hpp"
 #include "utilities/shapes.hpp"
 #include "utilities/utils.hpp"
 
@@ -23,6 +37,14 @@ Camera *camera;
 Keyboard *keyboard;
 SkyboxManager *skyboxManager;
 ShaderManager *shaderManager;
+MaterialManager *materialManager;
+StreamBuffer *frameData;
+OcclusionCuller *occlusionCuller;
+ThreadPool *workers;
+AssetLoader *loader;
+
+// The camera as it should be drawn this frame (interpolated from the simulation snapshots)
+CameraState renderCamera;
 
 SceneNode *root;
 SceneNode *shapes;
@@ -46,6 +68,25 @@ void keyboardCallback(GLFWwindow *window, int key, int scancode, int action, int
     if (key == GLFW_KEY_L && action == GLFW_PRESS) skyboxManager->swapSkybox();
     if (key == GLFW_KEY_T && action == GLFW_PRESS) rotateBust = !rotateBust;
     if (key == GLFW_KEY_M && action == GLFW_PRESS) bust->swapAppearance();
+    if (key == GLFW_KEY_I && action == GLFW_PRESS)
+    {
+        GLSTATE::printStatistics();
+        GLSTATE::resetStatistics();
+    }
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) PROFILER::printStatistics();
+    if (key == GLFW_KEY_J && action == GLFW_PRESS)
+    {
+        std::string file = OPTIONS::traceFile.empty() ? "trace.json" : OPTIONS::traceFile;
+        if (!OPTIONS::tracing)
+            printf("Tracing is disabled, enable OPTIONS::tracing to record a trace\n");
+        else if (TRACE::write(file))
+            printf("Wrote trace to %s\n", file.c_str());
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        framePacer->printStatistics();
+        framePacer->resetStatistics();
+    }
     if (key == GLFW_KEY_N && action == GLFW_PRESS)
         for (SceneNode *node : shapes->children) node->swapAppearance();
     if (key == GLFW_KEY_RIGHT && action == GLFW_PRESS)
@@ -72,22 +113,38 @@ void mouseScrollCallback(GLFWwindow *window, double xoffset, double yoffset)
 
 
 
-/** Executed once before main loop */
+/** Executed once before main loop, window is nullptr when running headless */
 void initScene(GLFWwindow *window)
 {
-    glfwSetCursorPosCallback(window, mouseCallback);
-    glfwSetScrollCallback(window, mouseScrollCallback);
-    glfwSetKeyCallback(window, keyboardCallback);
+    TRACE::Scope scope("initScene", "loading");
+    // There is no window (and no input) when running headless
+    if (window != nullptr)
+    {
+        glfwSetCursorPosCallback(window, mouseCallback);
+        glfwSetScrollCallback(window, mouseScrollCallback);
+        glfwSetKeyCallback(window, keyboardCallback);
+    }
 
+    // Files are read in the background, the scene starts out with placeholders that are replaced as they are uploaded
+    loader        = new AssetLoader(OPTIONS::loaderThreads);
     keyboard      = new Keyboard();
     camera        = new Camera(glm::vec3(0, 0, 30));
     shaderManager = new ShaderManager();
-    skyboxManager = new SkyboxManager();
+    skyboxManager = new SkyboxManager(loader);
+
+    materialManager = new MaterialManager();
+    frameData       = new StreamBuffer(OPTIONS::frameDataSize);
+    occlusionCuller = new OcclusionCuller();
+    workers         = new ThreadPool(OPTIONS::workerThreads);
 
     // Create And Inititalize Nodes and SceneGraph
     root = new SceneNode();
     initSceneGraph();
+    root->updateTransformations(glm::mat4(1));
     if (OPTIONS::verbose) printf("Initilized scene with %d nodes\n", root->getNumChildren());
+
+    // Headless runs render a fixed number of frames to measure or compare them, so they need the whole scene from the start
+    if (window == nullptr) loader->finish();
 }
 
 
@@ -126,12 +183,17 @@ void initSceneGraph()
     // Rotating Bust
     std::string resolution = "1k";
     if (OPTIONS::mode == OPTIONS::DEMO) resolution = "4k";
-    bust = SceneNode::fromModelName("marble_bust", resolution, SUNLIT);
+    bust = SceneNode::fromModelName("marble_bust", resolution, SUNLIT, materialManager, workers, loader);
 
     bust->setScale(100);
     bust->translate(0, -25, 85);
     bust->rotate(0, 180, 0);
     root->addChild(bust);
+
+    // Imported glTF scene, three nodes (in a hierarchy with their own transformations) sharing a mesh of two primitives
+    SceneNode *imported = SceneNode::fromGLTF("cube_instances/cube_instances.gltf", SUNLIT, workers);
+    imported->translate(-70, 0, 0);
+    root->addChild(imported);
 }
 
 
@@ -143,12 +205,95 @@ void initSceneGraph()
  */
 void updateState(float deltaTime)
 {
-    // Update all positions and states
+    PROFILER::Zone zone("update", false); // runs on the simulation thread, so no GPU timing
+    // Update all positions and states, the transformations are computed by the renderer from the snapshots
     camera->updatePosition(deltaTime, keyboard->keysCurrentlyPressed);
     if (rotateBust) bust->rotate(0, deltaTime * 15.0f, 0);
+}
 
-    // Update all transformations to match the new positions
-    root->updateTransformations(glm::mat4(1));
+
+
+/**
+ * @brief Called by the simulation after each update, copies everything that moves into the snapshot
+ *
+ * @param snapshot Where to store the state, its memory is reused between ticks
+ */
+void captureState(Snapshot &snapshot)
+{
+    snapshot.nodes.clear();
+    for (SceneNode *node : root->getAllChildren()) snapshot.nodes.push_back(node->getState());
+
+    snapshot.camera.position = camera->position;
+    snapshot.camera.front    = camera->front;
+    snapshot.camera.up       = camera->up;
+    snapshot.camera.FOV      = camera->FOV;
+}
+
+
+
+/**
+ * @brief Sets the transformations of all nodes and the camera to a point between two snapshots
+ *
+ * @param previous The older snapshot
+ * @param current The newer snapshot
+ * @param alpha How far between previous (0) and current (1) to draw the scene
+ */
+void applySnapshots(Snapshot const &previous, Snapshot const &current, float alpha)
+{
+    if (previous.nodes.size() != current.nodes.size()) return;
+
+    std::vector<NodeState> states(current.nodes.size());
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        states[i].position = glm::mix(previous.nodes[i].position, current.nodes[i].position, alpha);
+        states[i].rotation = glm::mix(previous.nodes[i].rotation, current.nodes[i].rotation, alpha);
+        states[i].scale    = glm::mix(previous.nodes[i].scale, current.nodes[i].scale, alpha);
+    }
+    // The states are in the same order as getAllChildren(), which is depth first like this recursion
+    size_t index = 0;
+
+    std::function<void(SceneNode *, glm::mat4)> updateTransforms = [&](SceneNode *node, glm::mat4 parentModelMatrix)
+    {
+        for (SceneNode *child : node->children)
+        {
+            if (states.size() <= index) return;
+            child->updateTransformations(parentModelMatrix, states[index++]);
+            updateTransforms(child, child->M);
+        }
+    };
+    updateTransforms(root, glm::mat4(1));
+
+    renderCamera.position = glm::mix(previous.camera.position, current.camera.position, alpha);
+    renderCamera.front    = glm::normalize(glm::mix(previous.camera.front, current.camera.front, alpha));
+    renderCamera.up       = glm::normalize(glm::mix(previous.camera.up, current.camera.up, alpha));
+    renderCamera.FOV      = glm::mix(previous.camera.FOV, current.camera.FOV, alpha);
+}
+
+
+
+/** The views rendered by the regression test, between them they cover all the nodes and a few skyboxes */
+std::vector<FixedView> getFixedViews()
+{
+    return {
+        { "shapes", glm::vec3(0, 0, 30), -90.0f, 0.0f, 0 },
+        { "bust", glm::vec3(0, 5, 30), 90.0f, -10.0f, 1 },
+        { "overview", glm::vec3(-45, 25, 45), -45.0f, -20.0f, 3 },
+        { "gltf", glm::vec3(-30, 5, 0), 180.0f, -5.0f, 2 },
+    };
+}
+
+/**
+ * @brief Moves the camera and selects the skybox of the view, and forgets the environment maps,
+ * so the view looks the same no matter what was rendered before it
+ */
+void setFixedView(FixedView const &view)
+{
+    camera->position = view.position;
+    camera->yaw      = view.yaw;
+    camera->pitch    = view.pitch;
+    camera->updateCameraViewVectors();
+    skyboxManager->setSkybox(view.skybox);
+    for (SceneNode *node : root->getAllChildren()) node->hasEnvironmentMap = false;
 }
 
 
@@ -158,20 +303,32 @@ void updateState(float deltaTime)
  */
 void renderFrame()
 {
+    // Wait until the GPU is done with the per frame data from a few frames ago, so it can be reused
+    frameData->beginFrame();
+
+    // Assets that are done loading replace their placeholders, a few per frame so no frame takes much longer than the rest
+    {
+        PROFILER::Zone zone("uploads");
+        loader->uploadReady(OPTIONS::uploadBudget);
+    }
+
     // First we need to get accurate reflections and refractions for the nodes that need it
-    updateEnvironmentBuffers();
+    {
+        PROFILER::Zone zone("environment");
+        updateEnvironmentBuffers();
+    }
 
     // Once all buffers are filled, we can render the scene from the cameras perspective
-    glm::mat4 projection = UTILS::getPerspectiveMatrix(camera->FOV, float(WINDOW::width) / float(WINDOW::height));
-    glm::mat4 view       = UTILS::getViewMatrix(camera->position, camera->front, camera->up);
+    glm::mat4 projection = UTILS::getPerspectiveMatrix(renderCamera.FOV, float(Framebuffer::getScreenWidth()) / float(Framebuffer::getScreenHeight()));
+    glm::mat4 view       = UTILS::getViewMatrix(renderCamera.position, renderCamera.front, renderCamera.up);
     // Activate correct framebuffer
     Framebuffer::activateScreen();
     // Render The scene
-    skyboxManager->render(view, projection);
-    for (SceneNode *node : root->getAllChildren())
     {
-        renderNode(node, view, projection, camera->position, shaderManager->getShaderFor(node));
+        PROFILER::Zone zone("main pass");
+        renderScene(view, projection, renderCamera.position, nullptr, Framebuffer::getScreenHeight(), OPTIONS::lodPixelError);
     }
+    frameData->endFrame();
 }
 
 
@@ -186,32 +343,125 @@ void renderFrame()
  */
 void updateEnvironmentBuffers()
 {
+    int probe = 0;
     for (SceneNode *masterNode : root->getAllChildren())
     {
         // Make sure node actually needs the environment map
         if (masterNode->appearance != REFLECTIVE && masterNode->appearance != REFRACTIVE) continue;
 
-        masterNode->environmentBuffer->activate();
+        std::string probeName = "probe " + std::to_string(probe++);
+        PROFILER::Zone probeZone(probeName);
+
+        glm::vec3 position = masterNode->getWorldPosition();
+        masterNode->getEnvironmentBuffer()->activate();
         for (unsigned int side = 0; side < 6; side++)
         {
+            PROFILER::Zone faceZone(probeName + " face " + std::to_string(side));
             glm::mat4 projection = UTILS::getPerspectiveMatrix(90.0f, 1.0f);
-            glm::mat4 view       = UTILS::getViewMatrix(masterNode->position, CubemapDirections::view[side], CubemapDirections::up[side]);
+            glm::mat4 view       = UTILS::getViewMatrix(position, CubemapDirections::view[side], CubemapDirections::up[side]);
 
-            masterNode->environmentBuffer->selectRenderTargetSide(side);
+            masterNode->getEnvironmentBuffer()->selectRenderTargetSide(side);
 
             // Render Scene, but skip this node
-            skyboxManager->render(view, projection);
-            for (SceneNode *node : root->getAllChildren())
-            {
-                if (node == masterNode) continue;
-                renderNode(node, view, projection, masterNode->position, shaderManager->getShaderFor(node));
-            }
+            renderScene(view, projection, position, masterNode, masterNode->environmentResolution, OPTIONS::lodProbePixelError);
         }
         masterNode->hasEnvironmentMap = true;
     }
 }
 
 
+/**
+ * @brief Finds all nodes that should be drawn from the given position, sorted front to back
+ * so that nearby geometry fills the depth buffer first and hides what is behind it.
+ *
+ * @param eyePosition The position the scene is seen from
+ * @param skip Node to leave out (can be nullptr)
+ */
+std::vector<SceneNode *> getRenderQueue(glm::vec3 eyePosition, SceneNode *skip)
+{
+    std::vector<std::pair<float, SceneNode *>> sortable;
+    for (SceneNode *node : root->getAllChildren())
+    {
+        if (node == skip || node->vao.ID == -1) continue;
+        glm::vec3 offset = node->getWorldPosition() - eyePosition;
+        sortable.push_back({ glm::dot(offset, offset), node });
+    }
+    std::sort(sortable.begin(), sortable.end(), [](const std::pair<float, SceneNode *> &a, const std::pair<float, SceneNode *> &b)
+              { return a.first < b.first; });
+
+    std::vector<SceneNode *> queue;
+    for (auto &entry : sortable) queue.push_back(entry.second);
+    return queue;
+}
+
+
+
+/**
+ * @brief Renders all nodes (except skip) and then the skybox into the active framebuffer
+ *
+ * Expensive nodes are first drawn into the depth buffer only (if enabled in options), and then shaded
+ * with depth writes disabled, so every pixel of them is shaded exactly once. Nodes whose bounding box
+ * is hidden behind what has already been drawn are skipped by the GPU (see OcclusionCuller). The skybox
+ * is drawn last at max depth, so pixels hidden behind geometry are never shaded. Each node is drawn at the coarsest
+ * level of detail that is at most maxPixelError pixels off, and only the meshlets of it that can be seen.
+ *
+ * @param view View Matrix
+ * @param projection Projection Matrix
+ * @param eyePosition The position of which the nodes should be seen from
+ * @param skip Node to leave out (can be nullptr)
+ * @param viewportHeight Height of the framebuffer drawn to, in pixels
+ * @param maxPixelError Largest error on screen allowed for a level of detail
+ */
+void renderScene(glm::mat4 view, glm::mat4 projection, glm::vec3 eyePosition, SceneNode *skip, int viewportHeight, float maxPixelError)
+{
+    std::vector<SceneNode *> queue = getRenderQueue(eyePosition, skip);
+    {
+        PROFILER::Zone zone("meshlet culling", false);
+        for (SceneNode *node : queue)
+        {
+            node->selectLOD(eyePosition, projection, viewportHeight, maxPixelError);
+            if (OPTIONS::meshletCulling) node->cullMeshlets(view, projection, eyePosition, workers, frameData);
+        }
+    }
+    skyboxManager->bind();
+    occlusionCuller->beginView();
+
+    // Depth pre-pass
+    if (OPTIONS::depthPrePass)
+    {
+        GLSTATE::colorMask(GL_FALSE);
+        for (SceneNode *node : queue)
+        {
+            if (!shaderManager->isExpensive(node)) continue;
+            occlusionCuller->test(node, view, projection, eyePosition);
+            occlusionCuller->begin(node);
+            renderNode(node, view, projection, eyePosition, shaderManager->depthShader);
+            occlusionCuller->end(node);
+        }
+        GLSTATE::colorMask(GL_TRUE);
+    }
+
+    // Shading pass
+    for (SceneNode *node : queue)
+    {
+        bool hasDepth = OPTIONS::depthPrePass && shaderManager->isExpensive(node);
+        // Nodes from the pre-pass are already tested, the rest are tested against everything drawn before them
+        occlusionCuller->test(node, view, projection, eyePosition);
+        GLSTATE::depthFunc(hasDepth ? GL_LEQUAL : GL_LESS);
+        GLSTATE::depthMask(hasDepth ? GL_FALSE : GL_TRUE);
+        occlusionCuller->begin(node);
+        renderNode(node, view, projection, eyePosition, shaderManager->getShaderFor(node));
+        occlusionCuller->end(node);
+    }
+    GLSTATE::depthFunc(GL_LESS);
+    GLSTATE::depthMask(GL_TRUE);
+
+    PROFILER::Zone zone("skybox");
+    skyboxManager->render(view, projection);
+}
+
+
+
 /**
  * @brief Activates the shader. Passes all scene information to the shader and renders the node
  *
@@ -231,7 +481,7 @@ void renderNode(SceneNode *node, glm::mat4 view, glm::mat4 projection, glm::vec3
     shader->setUniform(UNIFORMS::camera_position, cameraPosition);
     shader->setUniform(UNIFORMS::sunlight_color, skyboxManager->getSunlightColor());
     shader->setUniform(UNIFORMS::sunlight_direction, skyboxManager->getSunlightDirection());
-    glBindTextureUnit(BINDINGS::skybox, skyboxManager->getTextureID());
+    materialManager->bind(node->materialID, shader);
 
-    node->render(shader);
+    node->render(shader, frameData);
 }
\ No newline at end of file
@@ -1,15 +1,35 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include <GLFW/glfw3.h>
 
 #include "classes/sceneNode.hpp"
 #include "classes/shader.hpp"
+#include "classes/simulation.hpp"
+
 
 
+// A camera placement and skybox that always shows the scene the same way (used by the regression test)
+struct FixedView
+{
+    std::string name; // no spaces, used in file names
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    int skybox;
+};
 
 void initScene(GLFWwindow *window);
 void initSceneGraph();
 void updateState(float deltaTime);
+void captureState(Snapshot &snapshot);
+void applySnapshots(Snapshot const &previous, Snapshot const &current, float alpha);
+std::vector<FixedView> getFixedViews();
+void setFixedView(FixedView const &view);
 void updateEnvironmentBuffers();
 void renderFrame();
+std::vector<SceneNode *> getRenderQueue(glm::vec3 eyePosition, SceneNode *skip);
+void renderScene(glm::mat4 view, glm::mat4 projection, glm::vec3 eyePosition, SceneNode *skip, int viewportHeight, float maxPixelError);
 void renderNode(SceneNode *node, glm::mat4 view, glm::mat4 projection, glm::vec3 cameraPosition, Shader *shader);
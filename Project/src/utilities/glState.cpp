@@ -0,0 +1,174 @@
+#include "glState.hpp"
+
+#include <cstdio>
+
+
+
+namespace GLSTATE
+{
+    const int maxTextureUnits = 32;
+    const GLuint unknown      = 0xFFFFFFFF;
+
+    // Last known values, "unknown" forces the next call through
+    GLuint program                   = unknown;
+    GLuint vertexArray               = unknown;
+    GLuint textures[maxTextureUnits] = {}; // all units start with texture 0
+    GLuint framebuffer               = unknown;
+    GLint viewportValues[4]          = { -1, -1, -1, -1 };
+    GLuint depthMaskValue            = unknown;
+    GLenum depthFuncValue            = unknown;
+    GLuint colorMaskValue            = unknown;
+    GLuint cullFaceValue             = unknown;
+
+    GLStateStatistics statistics;
+
+
+
+    /** Returns true if the value changed and the GL call should be issued */
+    template <class T>
+    bool update(T &current, T value)
+    {
+        if (current == value)
+        {
+            statistics.skipped++;
+            return false;
+        }
+        current = value;
+        statistics.issued++;
+        return true;
+    }
+
+    void useProgram(GLuint id)
+    {
+        if (update(program, id)) glUseProgram(id);
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (update(vertexArray, vao)) glBindVertexArray(vao);
+    }
+
+    void bindTextureUnit(GLuint unit, GLuint texture)
+    {
+        if (maxTextureUnits <= unit)
+        {
+            statistics.issued++;
+            glBindTextureUnit(unit, texture);
+            return;
+        }
+        if (update(textures[unit], texture)) glBindTextureUnit(unit, texture);
+    }
+
+    void bindFramebuffer(GLuint id)
+    {
+        if (update(framebuffer, id)) glBindFramebuffer(GL_FRAMEBUFFER, id);
+    }
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (viewportValues[0] == x && viewportValues[1] == y && viewportValues[2] == width && viewportValues[3] == height)
+        {
+            statistics.skipped++;
+            return;
+        }
+        viewportValues[0] = x;
+        viewportValues[1] = y;
+        viewportValues[2] = width;
+        viewportValues[3] = height;
+        statistics.issued++;
+        glViewport(x, y, width, height);
+    }
+
+    void depthMask(GLboolean enabled)
+    {
+        if (update(depthMaskValue, (GLuint)enabled)) glDepthMask(enabled);
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (update(depthFuncValue, func)) glDepthFunc(func);
+    }
+
+    void colorMask(GLboolean enabled)
+    {
+        if (update(colorMaskValue, (GLuint)enabled)) glColorMask(enabled, enabled, enabled, enabled);
+    }
+
+    void cullFace(GLboolean enabled)
+    {
+        if (!update(cullFaceValue, (GLuint)enabled)) return;
+        if (enabled)
+            glEnable(GL_CULL_FACE);
+        else
+            glDisable(GL_CULL_FACE);
+    }
+
+    GLboolean getDepthMask()
+    {
+        // Only asks the driver when the value is not known, which is never the case once the mask has been set through here
+        if (depthMaskValue == unknown)
+        {
+            GLboolean enabled;
+            glGetBooleanv(GL_DEPTH_WRITEMASK, &enabled);
+            depthMaskValue = enabled;
+        }
+        return (GLboolean)depthMaskValue;
+    }
+
+    GLboolean getColorMask()
+    {
+        if (colorMaskValue == unknown)
+        {
+            GLboolean enabled[4];
+            glGetBooleanv(GL_COLOR_WRITEMASK, enabled);
+            colorMaskValue = enabled[0];
+        }
+        return (GLboolean)colorMaskValue;
+    }
+
+    GLboolean getCullFace()
+    {
+        if (cullFaceValue == unknown) cullFaceValue = glIsEnabled(GL_CULL_FACE);
+        return (GLboolean)cullFaceValue;
+    }
+
+    void invalidate()
+    {
+        program     = unknown;
+        vertexArray = unknown;
+        for (GLuint &texture : textures) texture = unknown;
+        framebuffer = unknown;
+        for (GLint &value : viewportValues) value = -1;
+        depthMaskValue = unknown;
+        depthFuncValue = unknown;
+        colorMaskValue = unknown;
+        cullFaceValue  = unknown;
+    }
+
+    void countIssued()
+    {
+        statistics.issued++;
+    }
+
+    void countSkipped()
+    {
+        statistics.skipped++;
+    }
+
+    GLStateStatistics getStatistics()
+    {
+        return statistics;
+    }
+
+    void resetStatistics()
+    {
+        statistics = GLStateStatistics();
+    }
+
+    void printStatistics()
+    {
+        unsigned long total = statistics.issued + statistics.skipped;
+        float percentage    = total == 0 ? 0.0f : 100.0f * statistics.skipped / total;
+        printf("GL State: %lu calls issued, %lu skipped (%.1f%%)\n", statistics.issued, statistics.skipped, percentage);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+
+
+
+// Number of GL calls that went through the state cache, and how many of them were skipped because they would not change anything
+struct GLStateStatistics
+{
+    unsigned long issued  = 0;
+    unsigned long skipped = 0;
+};
+
+/**
+ * Thin layer on top of the OpenGL state that remembers what is currently bound/set, and skips calls that would not
+ * change anything. All state changes that are done often (every pass or every draw) should go through here, otherwise
+ * the cache gets out of sync with the real state.
+ */
+namespace GLSTATE
+{
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindTextureUnit(GLuint unit, GLuint texture);
+    void bindFramebuffer(GLuint framebuffer);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void depthMask(GLboolean enabled);
+    void depthFunc(GLenum func);
+    void colorMask(GLboolean enabled);
+    void cullFace(GLboolean enabled); // enables or disables GL_CULL_FACE
+
+    // The current state, from the cache so it can be saved and restored without waiting for the driver
+    GLboolean getDepthMask();
+    GLboolean getColorMask();
+    GLboolean getCullFace();
+
+    // Forget everything, use after state has been changed outside of this layer (e.g. when deleting objects)
+    void invalidate();
+
+    // Used by other caches (like the uniform cache in Shader) to report to the same counters
+    void countIssued();
+    void countSkipped();
+
+    GLStateStatistics getStatistics();
+    void resetStatistics();
+    void printStatistics();
+}
@@ -0,0 +1,124 @@
+#include "headless.hpp"
+
+#include <cstdio>
+
+#include <glad/glad.h>
+
+#ifdef HAS_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "options.hpp"
+
+
+
+namespace HEADLESS
+{
+#ifdef HAS_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+
+
+    // Prefer a surfaceless display, it does not need a window system at all
+    EGLDisplay getDisplay()
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+        {
+            EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (surfaceless != EGL_NO_DISPLAY) return surfaceless;
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+
+
+    bool createContext()
+    {
+        display = getDisplay();
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            fprintf(stderr, "Headless: Could not initialize EGL\n");
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            fprintf(stderr, "Headless: EGL does not support desktop OpenGL\n");
+            return false;
+        }
+
+        // No surface is ever created, but the default surface type (window) is not available without a window system
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE };
+        EGLConfig config;
+        EGLint numConfigs;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+        {
+            fprintf(stderr, "Headless: No EGL config supports OpenGL\n");
+            return false;
+        }
+
+        // Ask for the newest version first, the shaders and DSA calls need at least 4.5
+        const EGLint versions[][2] = { { 4, 6 }, { 4, 5 } };
+        for (const EGLint *version : versions)
+        {
+            const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, version[0],
+                EGL_CONTEXT_MINOR_VERSION, version[1],
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+            };
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+            if (context != EGL_NO_CONTEXT) break;
+        }
+        if (context == EGL_NO_CONTEXT)
+        {
+            fprintf(stderr, "Headless: Could not create an OpenGL 4.5 context\n");
+            return false;
+        }
+
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            fprintf(stderr, "Headless: Could not make the context current (EGL_KHR_surfaceless_context missing?)\n");
+            return false;
+        }
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            fprintf(stderr, "Headless: Could not load OpenGL functions\n");
+            return false;
+        }
+
+        if (OPTIONS::verbose)
+        {
+            printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
+            printf("EGL\t %d.%d (headless)\n", major, minor);
+            printf("OpenGL\t %s\n", glGetString(GL_VERSION));
+            printf("GLSL\t %s\n\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+        }
+        return true;
+    }
+
+
+
+    void destroyContext()
+    {
+        if (display == EGL_NO_DISPLAY) return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+    }
+#else
+    bool createContext()
+    {
+        fprintf(stderr, "Headless: The program was built without EGL, headless mode is not available\n");
+        return false;
+    }
+
+    void destroyContext() { }
+#endif
+}
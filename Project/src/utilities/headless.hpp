@@ -0,0 +1,15 @@
+#pragma once
+
+
+
+/**
+ * Offscreen OpenGL context without any window, used to run on machines without a display (build servers, CI).
+ * Uses EGL on a surfaceless display (Mesa llvmpipe works), so rendering must go to a framebuffer object.
+ * Only available when the program was built with EGL (HAS_EGL), otherwise createContext() fails.
+ */
+namespace HEADLESS
+{
+    // Creates the context, makes it current and loads OpenGL, returns false if any of it failed
+    bool createContext();
+    void destroyContext();
+}
@@ -0,0 +1,263 @@
+#include "meshCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cgltf.h>
+
+#include "options.hpp"
+
+
+
+namespace MESHCACHE
+{
+    const char magic[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t key;
+    };
+
+    // Follows the header once per section, the offsets are from the start of the file
+    struct SectionEntry
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // Sections start at multiples of this, so arrays of vectors can be used right out of the mapping
+    const uint64_t alignment = 16;
+
+    uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        return hash;
+    }
+
+    /**
+     * @brief Adds the path, modification time and size of the file to the hash, and its contents if they are wanted
+     *
+     * @param contents (Output) The whole file, it is only read if this is given
+     * @return false if the file cannot be read
+     */
+    bool addFile(std::string const &path, uint64_t &hash, std::vector<char> *contents = nullptr)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) return false;
+        uint64_t modified = (uint64_t)info.st_mtime;
+        uint64_t size     = (uint64_t)info.st_size;
+        hash              = fnv1a(path.data(), path.size(), hash);
+        hash              = fnv1a(&modified, sizeof(modified), hash);
+        hash              = fnv1a(&size, sizeof(size), hash);
+        if (contents == nullptr) return true;
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        contents->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        hash = fnv1a(contents->data(), contents->size(), hash);
+        return true;
+    }
+
+    /** @brief The files the buffers of a glTF file are loaded from (not the embedded data: ones), empty for other files */
+    std::vector<std::string> bufferFiles(std::string const &source, std::vector<char> const &contents)
+    {
+        std::vector<std::string> files;
+        size_t dot = source.find_last_of('.');
+        std::string extension = dot == std::string::npos ? "" : source.substr(dot);
+        if (extension != ".gltf" && extension != ".glb") return files;
+
+        cgltf_options options;
+        memset(&options, 0, sizeof(cgltf_options));
+        cgltf_data *data = nullptr;
+        if (cgltf_parse(&options, contents.data(), contents.size(), &data) != cgltf_result_success) return files;
+
+        // Relative to the glTF file, like cgltf_load_buffers() finds them
+        size_t slash          = source.find_last_of("/\\");
+        std::string directory = slash == std::string::npos ? "" : source.substr(0, slash + 1);
+        for (cgltf_size i = 0; i < data->buffers_count; i++)
+        {
+            const char *uri = data->buffers[i].uri;
+            if (uri != nullptr && strncmp(uri, "data:", 5) != 0) files.push_back(directory + uri);
+        }
+        cgltf_free(data);
+        return files;
+    }
+
+    /**
+     * @brief Key of the source as it is now, and of the options that change what is made from it. 0 if it cannot be read.
+     * A glTF file's buffer files are part of the source, only their modification time and size so they are not read
+     * every time the cache is checked (they are the biggest part of a model)
+     */
+    uint64_t key(std::string const &source)
+    {
+        uint64_t hash = fnv1a(nullptr, 0);
+        std::vector<char> contents;
+        if (!addFile(source, hash, &contents)) return 0;
+        for (std::string const &buffer : bufferFiles(source, contents))
+            if (!addFile(buffer, hash)) return 0;
+
+        int settings[] = { OPTIONS::optimizeMeshes, OPTIONS::lodLevels, OPTIONS::meshletCulling };
+        hash           = fnv1a(settings, sizeof(settings), hash);
+        return hash == 0 ? 1 : hash;
+    }
+
+    uint64_t alignUp(uint64_t offset)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+
+
+    MappedFile::MappedFile(std::string const &path)
+    {
+#ifdef _WIN32
+        HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) return;
+        file = fileHandle;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) return;
+        mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) return;
+
+        data = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data) size = (size_t)fileSize.QuadPart;
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) return;
+
+        // The mapping stays valid after the file is closed
+        struct stat info;
+        if (fstat(descriptor, &info) == 0 && info.st_size > 0)
+        {
+            void *mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapped != MAP_FAILED)
+            {
+                data = static_cast<const unsigned char *>(mapped);
+                size = (size_t)info.st_size;
+            }
+        }
+        close(descriptor);
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file) CloseHandle(file);
+#else
+        if (data) munmap(const_cast<unsigned char *>(data), size);
+#endif
+    }
+
+
+
+    std::string cachePath(std::string const &source)
+    {
+        // The name of the source, and a hash of its whole path in case two sources have the same name
+        size_t slash = source.find_last_of("/\\");
+        std::string name = slash == std::string::npos ? source : source.substr(slash + 1);
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)fnv1a(source.data(), source.size()));
+        return name + "." + hash + ".meshcache";
+    }
+
+    bool write(std::string const &source, std::vector<Section> const &sections)
+    {
+        uint64_t sourceKey = key(source);
+        if (sourceKey == 0) return false;
+
+        Header header;
+        memcpy(header.magic, magic, sizeof(magic));
+        header.version      = version;
+        header.sectionCount = (uint32_t)sections.size();
+        header.key          = sourceKey;
+
+        std::vector<SectionEntry> entries(sections.size());
+        uint64_t offset = alignUp(sizeof(Header) + entries.size() * sizeof(SectionEntry));
+        for (size_t i = 0; i < sections.size(); i++)
+        {
+            entries[i] = { offset, (uint64_t)sections[i].size };
+            offset     = alignUp(offset + sections[i].size);
+        }
+
+        // Written to a temporary file first, so a run that stops halfway never leaves a broken cache file behind
+        std::string path      = cachePath(source);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(SectionEntry));
+
+            const char padding[alignment] = {};
+            uint64_t written              = sizeof(Header) + entries.size() * sizeof(SectionEntry);
+            for (size_t i = 0; i < sections.size(); i++)
+            {
+                file.write(padding, entries[i].offset - written);
+                file.write(static_cast<const char *>(sections[i].data), sections[i].size);
+                written = entries[i].offset + sections[i].size;
+            }
+            if (!file)
+            {
+                fprintf(stderr, "Could not write mesh cache %s\n", temporary.c_str());
+                file.close();
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+
+        std::remove(path.c_str());
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) return false;
+        if (OPTIONS::verbose) printf("Wrote mesh cache %s (%llu bytes)\n", path.c_str(), (unsigned long long)offset);
+        return true;
+    }
+
+    MappedFile *read(std::string const &source, std::vector<Section> &sections)
+    {
+        uint64_t sourceKey = key(source);
+        if (sourceKey == 0) return nullptr;
+
+        MappedFile *file = new MappedFile(cachePath(source));
+        Header header;
+        bool valid = file->data && sizeof(Header) <= file->size;
+        if (valid) memcpy(&header, file->data, sizeof(Header));
+        valid = valid && memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == version && header.key == sourceKey;
+        valid = valid && sizeof(Header) + header.sectionCount * sizeof(SectionEntry) <= file->size;
+
+        sections.clear();
+        for (uint32_t i = 0; valid && i < header.sectionCount; i++)
+        {
+            SectionEntry entry;
+            memcpy(&entry, file->data + sizeof(Header) + i * sizeof(SectionEntry), sizeof(SectionEntry));
+            valid = entry.offset <= file->size && entry.size <= file->size - entry.offset;
+            if (valid) sections.push_back({ file->data + entry.offset, (size_t)entry.size });
+        }
+
+        if (!valid)
+        {
+            sections.clear();
+            delete file;
+            return nullptr;
+        }
+        return file;
+    }
+}
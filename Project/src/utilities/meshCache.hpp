@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+
+/**
+ * Stores what was made from a model file (processed and ready to upload) in a binary file in the working directory,
+ * so later runs can skip parsing and processing the model, and upload straight from the file mapped into memory.
+ *
+ * A cache file is a header followed by sections, which are plain arrays the caller decides the meaning of. The header
+ * holds a key made from the source file (path, modification time, size and a hash of its contents), the buffer files a
+ * glTF source references (path, modification time and size) and the options that change the processing, a cache file
+ * with another key is out of date and ignored.
+ *
+ *      std::vector<MESHCACHE::Section> sections;
+ *      MESHCACHE::MappedFile *file = MESHCACHE::read(source, sections);
+ *      if (!file) { ...process the source...; MESHCACHE::write(source, { { vertices.data(), vertices.size() * sizeof(Vertex) } }); }
+ *      else { ...upload from sections[0].data...; delete file; }
+ */
+namespace MESHCACHE
+{
+    // Change when anything about the cached data changes, so old cache files are rebuilt
+    const uint32_t version = 2;
+
+    struct Section
+    {
+        const void *data = nullptr;
+        size_t size      = 0; // bytes
+    };
+
+    // A file mapped read only into memory (mmap, or a file mapping on Windows)
+    class MappedFile
+    {
+    public:
+        MappedFile(std::string const &path);
+        ~MappedFile();
+
+        const unsigned char *data = nullptr; // nullptr if the file could not be mapped
+        size_t size               = 0;
+
+    private:
+        MappedFile(MappedFile const &) = delete;
+        MappedFile &operator=(MappedFile const &) = delete;
+
+        void *file    = nullptr; // file handle on Windows
+        void *mapping = nullptr; // mapping handle on Windows
+    };
+
+    /** @brief Name of the cache file for a source file */
+    std::string cachePath(std::string const &source);
+
+    /** @brief Writes the sections to the cache file of the source, replacing the old one */
+    bool write(std::string const &source, std::vector<Section> const &sections);
+
+    /**
+     * @brief Maps the cache file of the source, if there is one made from the source as it is now
+     *
+     * @param sections (Output) The sections of the file, pointing into the mapping
+     * @return The mapping, delete it when done with the sections. nullptr if there is no up to date cache file
+     */
+    MappedFile *read(std::string const &source, std::vector<Section> &sections);
+}
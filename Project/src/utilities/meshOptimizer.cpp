@@ -0,0 +1,713 @@
+#include "meshOptimizer.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+#include "utilities/trace.hpp"
+
+
+
+namespace MESHOPT
+{
+    // Simulated FIFO post-transform cache, an entry is in the cache if it was inserted less than cacheSize misses ago
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t vertexCount) : timestamps(vertexCount, 0) {}
+
+        /** @brief Returns the number of the triangle's vertices that were not in the cache (vertex shader runs) */
+        unsigned int access(unsigned int a, unsigned int b, unsigned int c)
+        {
+            return access(a) + access(b) + access(c);
+        }
+
+        void reset()
+        {
+            time += cacheSize + 1;
+        }
+
+    private:
+        std::vector<unsigned int> timestamps;
+        unsigned int time = cacheSize + 1;
+
+        unsigned int access(unsigned int vertex)
+        {
+            if (time - timestamps[vertex] <= (unsigned int)cacheSize) return 0;
+            timestamps[vertex] = time++;
+            return 1;
+        }
+    };
+
+
+
+    CacheStatistics analyzeVertexCache(std::vector<unsigned int> const &indices, size_t vertexCount)
+    {
+        CacheStatistics statistics;
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) return statistics;
+
+        FifoCache cache(vertexCount);
+        std::vector<bool> used(vertexCount, false);
+        unsigned long misses = 0, usedCount = 0;
+        for (size_t i = 0; i < triangleCount * 3; i += 3)
+        {
+            misses += cache.access(indices[i], indices[i + 1], indices[i + 2]);
+            for (size_t k = i; k < i + 3; k++)
+            {
+                if (!used[indices[k]]) usedCount++;
+                used[indices[k]] = true;
+            }
+        }
+
+        statistics.acmr = misses / (double)triangleCount;
+        statistics.atvr = misses / (double)usedCount;
+        return statistics;
+    }
+
+
+
+    /**
+     * Vertex cache optimization
+     *
+     * Every vertex gets a score from its position in a simulated LRU cache and from how many of its triangles are not
+     * yet drawn, and every triangle the sum of the scores of its vertices. The triangle with the highest score is drawn
+     * next, only triangles that touch the cache need to be considered (and rescored) after each step.
+     */
+
+    const int forsythCacheSize = 32;
+
+    float vertexScore(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0) return -1;
+
+        float score = 0;
+        if (0 <= cachePosition)
+        {
+            // The vertices of the last triangle get a fixed score, so the next triangle is not forced to share an edge
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / float(forsythCacheSize - 3), 1.5f);
+        }
+        // Boost vertices with few triangles left, so they are finished off instead of leaving lone triangles behind
+        score += 2.0f * std::pow((float)remainingTriangles, -0.5f);
+        return score;
+    }
+
+    void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+    {
+        TRACE::Scope scope("optimize vertex cache", "loading");
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) return;
+
+        // The triangles of each vertex, the first remaining[vertex] of them are not drawn yet
+        std::vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) remaining[indices[i]]++;
+        for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + remaining[v];
+        std::vector<unsigned int> adjacency(triangleCount * 3);
+        std::vector<unsigned int> filled(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+        std::vector<int> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) vertexScores[v] = vertexScore(-1, remaining[v]);
+
+        std::vector<float> triangleScores(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+        }
+
+        // Changes the score of a vertex and of the triangles it still has
+        auto rescore = [&](unsigned int vertex) {
+            float score = vertexScore(cachePositions[vertex], remaining[vertex]);
+            float delta = score - vertexScores[vertex];
+            for (unsigned int i = offsets[vertex]; i < offsets[vertex] + remaining[vertex]; i++) triangleScores[adjacency[i]] += delta;
+            vertexScores[vertex] = score;
+        };
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> cache, newCache, result;
+        result.reserve(triangleCount * 3);
+        size_t cursor = 0; // every triangle before this is drawn
+        long best     = -1;
+
+        while (result.size() < triangleCount * 3)
+        {
+            // Nothing in the cache has triangles left, continue with the first triangle not drawn yet
+            if (best < 0)
+            {
+                while (emitted[cursor]) cursor++;
+                best = (long)cursor;
+            }
+            emitted[best] = true;
+
+            // Draw the triangle and move its vertices to the front of the cache
+            newCache.clear();
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int vertex = indices[best * 3 + k];
+                result.push_back(vertex);
+
+                // Remove the triangle from the ones the vertex has left
+                unsigned int last = offsets[vertex] + --remaining[vertex];
+                for (unsigned int i = offsets[vertex]; i < last; i++)
+                {
+                    if (adjacency[i] != (unsigned int)best) continue;
+                    std::swap(adjacency[i], adjacency[last]);
+                    break;
+                }
+                if (std::find(newCache.begin(), newCache.end(), vertex) == newCache.end()) newCache.push_back(vertex);
+            }
+            size_t triangleVertices = newCache.size();
+            for (unsigned int vertex : cache)
+            {
+                if (std::find(newCache.begin(), newCache.begin() + triangleVertices, vertex) == newCache.begin() + triangleVertices) newCache.push_back(vertex);
+            }
+
+            // Vertices pushed out of the cache
+            for (size_t i = forsythCacheSize; i < newCache.size(); i++)
+            {
+                cachePositions[newCache[i]] = -1;
+                rescore(newCache[i]);
+            }
+            newCache.resize(std::min(newCache.size(), (size_t)forsythCacheSize));
+            cache.swap(newCache);
+
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                cachePositions[cache[i]] = (int)i;
+                rescore(cache[i]);
+            }
+
+            // The best triangle that touches the cache
+            best            = -1;
+            float bestScore = -1;
+            for (unsigned int vertex : cache)
+            {
+                for (unsigned int i = offsets[vertex]; i < offsets[vertex] + remaining[vertex]; i++)
+                {
+                    unsigned int triangle = adjacency[i];
+                    if (bestScore < triangleScores[triangle])
+                    {
+                        best      = triangle;
+                        bestScore = triangleScores[triangle];
+                    }
+                }
+            }
+        }
+
+        indices.swap(result);
+    }
+
+
+
+    /**
+     * Overdraw optimization
+     *
+     * The cache optimized order is split into clusters where it starts over anyway (a triangle with no vertex in the
+     * cache), and those are split further wherever the part so far is about as cache friendly as the whole cluster.
+     * The clusters are then sorted by how much they face away from the center of the mesh, so the outer surface is
+     * drawn first from any direction and the depth test rejects more of what follows.
+     */
+    void optimizeOverdraw(std::vector<unsigned int> &indices, std::vector<glm::vec3> const &vertices, float threshold)
+    {
+        TRACE::Scope scope("optimize overdraw", "loading");
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) return;
+
+        FifoCache cache(vertices.size());
+        std::vector<unsigned int> misses(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) misses[t] = cache.access(indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]);
+
+        // Hard boundaries, the first triangle of each cluster
+        std::vector<size_t> hardBoundaries;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (t == 0 || misses[t] == 3) hardBoundaries.push_back(t);
+        }
+        hardBoundaries.push_back(triangleCount);
+
+        // Soft boundaries, the cache is reset at each since the clusters will be drawn in another order
+        std::vector<size_t> clusters;
+        for (size_t c = 0; c + 1 < hardBoundaries.size(); c++)
+        {
+            size_t start = hardBoundaries[c], end = hardBoundaries[c + 1];
+
+            cache.reset();
+            unsigned long clusterMisses = 0;
+            for (size_t t = start; t < end; t++) clusterMisses += cache.access(indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]);
+            float limit = threshold * clusterMisses / float(end - start);
+
+            cache.reset();
+            clusters.push_back(start);
+            unsigned long runningMisses = 0;
+            size_t first                = start;
+            for (size_t t = start; t + 1 < end; t++)
+            {
+                runningMisses += cache.access(indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]);
+                if (runningMisses / float(t + 1 - first) <= limit)
+                {
+                    clusters.push_back(t + 1);
+                    first         = t + 1;
+                    runningMisses = 0;
+                    cache.reset();
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+        size_t clusterCount = clusters.size() - 1;
+
+        // Area weighted centroid and normal of each cluster, and of the whole mesh
+        std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0)), normals(clusterCount, glm::vec3(0));
+        glm::vec3 meshCentroid = glm::vec3(0);
+        float meshArea         = 0;
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            float clusterArea = 0;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+            {
+                glm::vec3 const &p0 = vertices[indices[t * 3]];
+                glm::vec3 const &p1 = vertices[indices[t * 3 + 1]];
+                glm::vec3 const &p2 = vertices[indices[t * 3 + 2]];
+                glm::vec3 normal    = glm::cross(p1 - p0, p2 - p0);
+                float area          = glm::length(normal);
+
+                centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+                normals[c] += normal;
+                clusterArea += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += clusterArea;
+            centroids[c] = 0 < clusterArea ? centroids[c] / clusterArea : glm::vec3(0);
+        }
+        if (0 < meshArea) meshCentroid /= meshArea;
+
+        std::vector<float> keys(clusterCount, 0);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            float length = glm::length(normals[c]);
+            if (0 < length) keys[c] = glm::dot(centroids[c] - meshCentroid, normals[c] / length);
+        }
+
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[b] < keys[a]; });
+
+        std::vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+        for (size_t c : order) result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+        indices.swap(result);
+    }
+
+
+
+    /**
+     * Simplification
+     *
+     * Every vertex has a quadric, the sum of the squared distances to the planes of the triangles around it (weighted
+     * by their area). The cost of collapsing a vertex onto a neighbour is its quadric at the neighbour's position, the
+     * neighbour takes over the quadric so later collapses are still measured against the original surface. Collapses
+     * are done in passes: all candidate edges are sorted by cost and the cheapest are done, as long as they do not
+     * touch each other or flip a triangle, then the indices are compacted and the next pass starts.
+     */
+
+    // Symmetric 4x4 matrix, error(p) is the weighted mean of the squared distances from p to the planes added
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+        double weight = 0;
+
+        void addPlane(glm::vec3 normal, float distance, float planeWeight)
+        {
+            double a = normal.x, b = normal.y, c = normal.z, d = distance, w = planeWeight;
+            a2 += w * a * a;
+            ab += w * a * b;
+            ac += w * a * c;
+            ad += w * a * d;
+            b2 += w * b * b;
+            bc += w * b * c;
+            bd += w * b * d;
+            c2 += w * c * c;
+            cd += w * c * d;
+            d2 += w * d * d;
+            weight += w;
+        }
+
+        void add(Quadric const &other)
+        {
+            a2 += other.a2;
+            ab += other.ab;
+            ac += other.ac;
+            ad += other.ad;
+            b2 += other.b2;
+            bc += other.bc;
+            bd += other.bd;
+            c2 += other.c2;
+            cd += other.cd;
+            d2 += other.d2;
+            weight += other.weight;
+        }
+
+        double error(glm::vec3 p) const
+        {
+            if (weight <= 0) return 0;
+            double x = p.x, y = p.y, z = p.z;
+            double e = a2 * x * x + b2 * y * y + c2 * z * z + 2 * (ab * x * y + ac * x * z + bc * y * z)
+                     + 2 * (ad * x + bd * y + cd * z) + d2;
+            return std::max(0.0, e / weight);
+        }
+    };
+
+    struct Collapse
+    {
+        unsigned int from;
+        unsigned int to;
+        double error; // squared distance
+    };
+
+    // Simplifies the same triangles further and further, keeping the quadrics between the calls
+    class Simplifier
+    {
+    public:
+        Simplifier(std::vector<unsigned int> const &indices, std::vector<glm::vec3> const &vertices)
+            : vertices(vertices), locked(vertices.size(), false), quadrics(vertices.size()), touched(vertices.size()), offsets(vertices.size() + 1)
+        {
+            size_t triangleIndices = indices.size() / 3 * 3;
+
+            // Vertices that share their position with another are on a seam (of normals or texture coordinates)
+            std::unordered_map<WeldKey, unsigned int, WeldKeyHash> positions;
+            positions.reserve(vertices.size());
+            for (size_t v = 0; v < vertices.size(); v++)
+            {
+                auto inserted = positions.emplace(WeldKey(vertices[v], glm::vec3(0), glm::vec2(0)), (unsigned int)v);
+                if (inserted.second) continue;
+                locked[v]                      = true;
+                locked[inserted.first->second] = true;
+            }
+
+            // Border edges are only used by one triangle, there is no triangle around b with the edge going back to a
+            std::vector<unsigned int> triangles(indices.begin(), indices.begin() + triangleIndices);
+            buildAdjacency(triangles);
+            for (size_t i = 0; i < triangles.size(); i++)
+            {
+                unsigned int a = triangles[i], b = triangles[next(i)];
+                bool border    = true;
+                for (unsigned int j = offsets[b]; j < offsets[b + 1] && border; j++)
+                {
+                    unsigned int *triangle = &triangles[adjacency[j] * 3];
+                    for (int k = 0; k < 3; k++) border = border && !(triangle[k] == b && triangle[(k + 1) % 3] == a);
+                }
+                if (!border) continue;
+                locked[a] = true;
+                locked[b] = true;
+            }
+
+            for (size_t i = 0; i < triangleIndices; i += 3)
+            {
+                glm::vec3 const &p0 = vertices[indices[i]];
+                glm::vec3 normal    = glm::cross(vertices[indices[i + 1]] - p0, vertices[indices[i + 2]] - p0);
+                float area          = glm::length(normal);
+                if (area <= 0) continue;
+                normal /= area;
+                for (int k = 0; k < 3; k++) quadrics[indices[i + k]].addPlane(normal, -glm::dot(normal, p0), area);
+            }
+        }
+
+        /** @brief Collapses edges of the indices (which must come from earlier calls or the constructor), see MESHOPT::simplify */
+        float simplify(std::vector<unsigned int> &indices, size_t targetIndexCount, float maxError)
+        {
+            indices.resize(indices.size() / 3 * 3);
+            double maxSquaredError = (double)maxError * maxError;
+
+            while (targetIndexCount < indices.size())
+            {
+                size_t removed = collapseEdges(indices, (indices.size() - targetIndexCount + 2) / 3, maxSquaredError);
+                if (removed == 0) break;
+
+                // Drop the triangles that collapsed
+                size_t kept = 0;
+                for (size_t i = 0; i < indices.size(); i += 3)
+                {
+                    unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+                    if (a == b || b == c || c == a) continue;
+                    indices[kept++] = a;
+                    indices[kept++] = b;
+                    indices[kept++] = c;
+                }
+                indices.resize(kept);
+            }
+            return (float)std::sqrt(error);
+        }
+
+    private:
+        std::vector<glm::vec3> const &vertices;
+        std::vector<bool> locked;
+        std::vector<Quadric> quadrics;
+        double error = 0; // largest squared error of the collapses so far
+
+        // Reused between passes
+        std::vector<Collapse> collapses;
+        std::vector<bool> touched;
+        std::vector<unsigned int> offsets, adjacency;
+
+        static size_t next(size_t i)
+        {
+            return i - i % 3 + (i % 3 + 1) % 3;
+        }
+
+        // The triangles around each vertex v are adjacency[offsets[v]] to adjacency[offsets[v + 1] - 1]
+        void buildAdjacency(std::vector<unsigned int> const &indices)
+        {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (unsigned int index : indices) offsets[index + 1]++;
+            for (size_t v = 0; v + 1 < offsets.size(); v++) offsets[v + 1] += offsets[v];
+            adjacency.resize(indices.size());
+            std::vector<unsigned int> filled(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++) adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+        }
+
+        // One pass, returns the number of triangles removed (they are left in the indices as degenerate triangles)
+        size_t collapseEdges(std::vector<unsigned int> &indices, size_t removable, double maxSquaredError)
+        {
+            buildAdjacency(indices);
+
+            // The cheaper direction of each edge (inner edges are in two triangles, only take them from one)
+            collapses.clear();
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                unsigned int a = indices[i], b = indices[next(i)];
+                if (b < a || (locked[a] && locked[b])) continue;
+                double ab = locked[a] ? DBL_MAX : quadrics[a].error(vertices[b]);
+                double ba = locked[b] ? DBL_MAX : quadrics[b].error(vertices[a]);
+                collapses.push_back(ab <= ba ? Collapse{ a, b, ab } : Collapse{ b, a, ba });
+            }
+            std::sort(collapses.begin(), collapses.end(), [](Collapse const &a, Collapse const &b) { return a.error < b.error; });
+
+            // A vertex can only be part of one collapse per pass, the adjacency of both ends is out of date after it
+            std::fill(touched.begin(), touched.end(), false);
+            size_t removed = 0;
+            for (Collapse const &collapse : collapses)
+            {
+                if (maxSquaredError < collapse.error || removable <= removed) break;
+                if (touched[collapse.from] || touched[collapse.to]) continue;
+
+                // Moving the vertex must not turn any of the triangles that remain around
+                bool flips     = false;
+                size_t removes = 0;
+                for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1] && !flips; i++)
+                {
+                    unsigned int *triangle = &indices[adjacency[i] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    {
+                        removes++;
+                        continue;
+                    }
+                    glm::vec3 corners[3], moved[3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        corners[k] = vertices[triangle[k]];
+                        moved[k]   = triangle[k] == collapse.from ? vertices[collapse.to] : corners[k];
+                    }
+                    glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    glm::vec3 after  = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                    // Also keep triangles from tilting too far, many small turns would add up to a flip
+                    flips = glm::dot(before, after) <= 0.5f * glm::length(before) * glm::length(after);
+                }
+                if (flips) continue;
+
+                for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++)
+                {
+                    unsigned int *triangle = &indices[adjacency[i] * 3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (triangle[k] == collapse.from) triangle[k] = collapse.to;
+                    }
+                }
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                touched[collapse.from] = true;
+                touched[collapse.to]   = true;
+                error                  = std::max(error, collapse.error);
+                removed += removes;
+            }
+            return removed;
+        }
+    };
+
+    float simplify(std::vector<unsigned int> &indices, std::vector<glm::vec3> const &vertices, size_t targetIndexCount, float maxError)
+    {
+        TRACE::Scope scope("simplify", "loading");
+        Simplifier simplifier(indices, vertices);
+        return simplifier.simplify(indices, targetIndexCount, maxError);
+    }
+
+    void generateLODs(Mesh &mesh)
+    {
+        TRACE::Scope scope("generate LODs", "loading");
+        mesh.lods.clear();
+
+        // Each level continues from the one before, with the quadrics of the original surface
+        std::vector<unsigned int> indices = mesh.indices;
+        Simplifier simplifier(indices, mesh.vertices);
+        for (int level = 1; level <= OPTIONS::lodLevels; level++)
+        {
+            size_t previousCount = indices.size();
+            if (previousCount < 3 * 64) break; // not worth it for tiny meshes
+
+            float error = simplifier.simplify(indices, previousCount / 6 * 3, FLT_MAX);
+            if (previousCount * 0.9 < indices.size()) break; // mostly locked vertices left
+
+            LevelOfDetail lod;
+            lod.indices = indices;
+            lod.error   = error;
+            optimizeVertexCache(lod.indices, mesh.vertices.size());
+            mesh.lods.push_back(lod);
+        }
+
+        if (!OPTIONS::verbose || mesh.lods.empty()) return;
+        printf("Generated %zu levels of detail:", mesh.lods.size());
+        for (LevelOfDetail const &lod : mesh.lods) printf(" %zu triangles (error %g)", lod.indices.size() / 3, lod.error);
+        printf("\n");
+    }
+
+
+
+    /**
+     * Meshlets
+     *
+     * Triangles are added to the current meshlet in order until one more would go over the vertex or triangle limit.
+     * The bounding sphere is centered on the bounding box, and the cone axis is the average of the triangle normals.
+     */
+    Meshlet finishMeshlet(std::vector<unsigned int> const &indices, std::vector<glm::vec3> const &vertices, size_t begin, size_t end)
+    {
+        Meshlet meshlet;
+        meshlet.firstIndex = (unsigned int)begin;
+        meshlet.indexCount = (unsigned int)(end - begin);
+
+        glm::vec3 min = vertices[indices[begin]], max = min;
+        for (size_t i = begin; i < end; i++)
+        {
+            min = glm::min(min, vertices[indices[i]]);
+            max = glm::max(max, vertices[indices[i]]);
+        }
+        meshlet.center = (min + max) * 0.5f;
+        for (size_t i = begin; i < end; i++) meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]] - meshlet.center));
+
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis = glm::vec3(0);
+        for (size_t i = begin; i < end; i += 3)
+        {
+            glm::vec3 const &p0 = vertices[indices[i]];
+            glm::vec3 normal    = glm::cross(vertices[indices[i + 1]] - p0, vertices[indices[i + 2]] - p0);
+            float length        = glm::length(normal);
+            if (length <= 0) continue;
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+        float axisLength = glm::length(axis);
+        if (axisLength <= 0) return meshlet;
+        meshlet.coneAxis = axis / axisLength;
+
+        // The widest angle between the axis and a normal, the cone can only be used if every normal is within 90 degrees
+        float minDot = 1;
+        for (glm::vec3 const &normal : normals) minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+        if (0.1f < minDot) meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+        return meshlet;
+    }
+
+    std::vector<Meshlet> buildMeshlets(std::vector<unsigned int> const &indices, std::vector<glm::vec3> const &vertices, size_t maxVertices, size_t maxTriangles)
+    {
+        std::vector<Meshlet> meshlets;
+        std::vector<unsigned int> stamps(vertices.size(), 0); // which meshlet (+1) each vertex was last added to
+        unsigned int stamp = 1;
+        size_t begin       = 0;
+        size_t vertexCount = 0;
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            size_t newVertices = 0;
+            for (size_t k = i; k < i + 3; k++) newVertices += stamps[indices[k]] != stamp;
+            if (maxVertices < vertexCount + newVertices || maxTriangles * 3 < i + 3 - begin)
+            {
+                meshlets.push_back(finishMeshlet(indices, vertices, begin, i));
+                begin       = i;
+                vertexCount = 0;
+                stamp++;
+            }
+            for (size_t k = i; k < i + 3; k++)
+            {
+                if (stamps[indices[k]] == stamp) continue;
+                stamps[indices[k]] = stamp;
+                vertexCount++;
+            }
+        }
+        size_t end = indices.size() / 3 * 3;
+        if (begin < end) meshlets.push_back(finishMeshlet(indices, vertices, begin, end));
+        return meshlets;
+    }
+
+    void buildMeshlets(Mesh &mesh)
+    {
+        TRACE::Scope scope("build meshlets", "loading");
+        mesh.meshlets = buildMeshlets(mesh.indices, mesh.vertices);
+        for (LevelOfDetail &lod : mesh.lods) lod.meshlets = buildMeshlets(lod.indices, mesh.vertices);
+    }
+
+
+
+    template <class T>
+    void reorder(std::vector<T> &attribute, std::vector<unsigned int> const &remap, size_t count)
+    {
+        if (attribute.size() != remap.size()) return;
+        std::vector<T> reordered(count);
+        for (size_t v = 0; v < remap.size(); v++)
+        {
+            if (remap[v] != ~0u) reordered[remap[v]] = attribute[v];
+        }
+        attribute.swap(reordered);
+    }
+
+    void optimizeVertexFetch(Mesh &mesh)
+    {
+        size_t vertexCount = mesh.vertices.size();
+        if (!mesh.normals.empty() && mesh.normals.size() != vertexCount) return;
+        if (!mesh.textureCoordinates.empty() && mesh.textureCoordinates.size() != vertexCount) return;
+        if (!mesh.tangents.empty() && mesh.tangents.size() != vertexCount) return;
+
+        std::vector<unsigned int> remap(vertexCount, ~0u);
+        unsigned int next = 0;
+        for (unsigned int &index : mesh.indices)
+        {
+            if (remap[index] == ~0u) remap[index] = next++;
+            index = remap[index];
+        }
+
+        for (LevelOfDetail &lod : mesh.lods)
+        {
+            for (unsigned int &index : lod.indices) index = remap[index];
+        }
+        reorder(mesh.vertices, remap, next);
+        reorder(mesh.normals, remap, next);
+        reorder(mesh.textureCoordinates, remap, next);
+        reorder(mesh.tangents, remap, next);
+    }
+
+
+
+    void optimize(Mesh &mesh)
+    {
+        TRACE::Scope scope("optimize mesh", "loading");
+        CacheStatistics before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+        optimizeVertexCache(mesh.indices, mesh.vertices.size());
+        optimizeOverdraw(mesh.indices, mesh.vertices);
+        optimizeVertexFetch(mesh);
+
+        if (!OPTIONS::verbose) return;
+        CacheStatistics after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+        printf("Optimized mesh with %zu triangles: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+               mesh.indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+}
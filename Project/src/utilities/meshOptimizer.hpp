@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include "classes/mesh.hpp"
+
+
+
+// How well the order of a mesh's triangles uses the post-transform vertex cache (simulated FIFO cache)
+struct CacheStatistics
+{
+    double acmr = 0; // average cache miss ratio, vertex shader runs per triangle (0.5 is the best possible, 3 the worst)
+    double atvr = 0; // average transformed vertex ratio, vertex shader runs per vertex (1 is the best possible)
+};
+
+/**
+ * Reorders the triangles and vertices of meshes after they are loaded, without changing what is drawn:
+ *
+ *      1. Triangles are ordered so vertices are reused while they are still in the vertex cache (Forsyth)
+ *      2. That order is cut into clusters, which are sorted so triangles facing outwards are drawn first and hide what
+ *         is behind them, from any direction (view independent overdraw reduction, like Tipsify)
+ *      3. Vertices are ordered by first use, so the vertex fetch reads memory mostly sequentially
+ */
+namespace MESHOPT
+{
+    const int cacheSize = 16; // entries of the simulated FIFO cache used for the statistics and the clustering
+
+    /** @brief Runs all passes on the mesh and prints the statistics before and after if verbose */
+    void optimize(Mesh &mesh);
+
+    /** @brief Reorders the triangles (indices) for vertex cache locality, using Tom Forsyth's linear-speed algorithm */
+    void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+    /**
+     * @brief Reorders clusters of triangles to reduce overdraw, while keeping most of the vertex cache locality.
+     * The indices should already be optimized for the vertex cache.
+     *
+     * @param threshold How much worse (as a factor) the ACMR of the clusters may get in exchange for smaller clusters
+     */
+    void optimizeOverdraw(std::vector<unsigned int> &indices, std::vector<glm::vec3> const &vertices, float threshold = 1.05f);
+
+    /** @brief Reorders the vertices (and their attributes) by first use in the indices, and drops unused ones */
+    void optimizeVertexFetch(Mesh &mesh);
+
+    /**
+     * @brief Simplifies the triangles by collapsing edges, cheapest first by quadric error (Garland & Heckbert).
+     * A vertex is always collapsed onto one of its neighbours, so the result still uses the same vertices. Vertices on
+     * the border of the mesh or on attribute seams (several vertices at one position) are never moved.
+     *
+     * @param targetIndexCount Stop when there are this few indices left
+     * @param maxError Skip collapses that would move the surface further than this (model space distance)
+     * @return The largest error of the collapses that were done (model space distance)
+     */
+    float simplify(std::vector<unsigned int> &indices, std::vector<glm::vec3> const &vertices, size_t targetIndexCount, float maxError);
+
+    /**
+     * @brief Fills mesh.lods with up to OPTIONS::lodLevels levels of detail, each with about half the triangles of the
+     * level before. Run after optimize(), the levels are ordered for the vertex cache but do not move vertices.
+     */
+    void generateLODs(Mesh &mesh);
+
+    /**
+     * @brief Splits the triangles into meshlets of consecutive triangles, in the order they are in (which should
+     * already be optimized, so neighbouring triangles are close together), with bounds and normal cones for culling
+     */
+    std::vector<Meshlet> buildMeshlets(std::vector<unsigned int> const &indices, std::vector<glm::vec3> const &vertices,
+                                       size_t maxVertices = 64, size_t maxTriangles = 124);
+
+    /** @brief Builds the meshlets of the full mesh and of every level of detail */
+    void buildMeshlets(Mesh &mesh);
+
+    CacheStatistics analyzeVertexCache(std::vector<unsigned int> const &indices, size_t vertexCount);
+}
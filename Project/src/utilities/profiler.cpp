@@ -0,0 +1,279 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "options.hpp"
+
+
+
+namespace PROFILER
+{
+    // Number of frames the GPU may be behind before its timings are dropped
+    const unsigned int latency = 4;
+
+    // A GPU zone waiting for its timestamps
+    struct PendingZone
+    {
+        unsigned long frame;
+        size_t sample;
+        GLuint begin;
+        GLuint end;
+    };
+
+    // Timestamp queries used during one frame, reused every latency frames
+    struct QuerySet
+    {
+        unsigned long frame = 0;
+        std::vector<GLuint> queries;
+        size_t used = 0;
+        std::vector<PendingZone> pending;
+    };
+
+    // Zones may be recorded from the simulation thread, everything except the queries is guarded by this
+    std::mutex mutex;
+
+    std::unordered_map<std::string, int> zoneIDs;
+    std::vector<std::string> zoneNames;
+    std::deque<ProfileFrame> history;
+    unsigned long currentFrame  = 0;
+    unsigned long droppedFrames = 0;
+    QuerySet querySets[latency];
+
+
+
+    int getZone(const std::string &name)
+    {
+        auto found = zoneIDs.find(name);
+        if (found != zoneIDs.end()) return found->second;
+        zoneNames.push_back(name);
+        zoneIDs[name] = (int)zoneNames.size() - 1;
+        return (int)zoneNames.size() - 1;
+    }
+
+    // The sample, or nullptr if its frame has already left the history
+    ProfileSample *findSample(unsigned long frame, size_t sample)
+    {
+        if (history.empty() || frame < history.front().frame || history.back().frame < frame) return nullptr;
+        ProfileFrame &record = history[frame - history.front().frame];
+        if (record.samples.size() <= sample) return nullptr;
+        return &record.samples[sample];
+    }
+
+    GLuint nextQuery(QuerySet &set)
+    {
+        if (set.used == set.queries.size())
+        {
+            GLuint query;
+            glCreateQueries(GL_TIMESTAMP, 1, &query);
+            set.queries.push_back(query);
+        }
+        return set.queries[set.used++];
+    }
+
+    /** Reads the GPU times of the set if they are available (without waiting), returns false if they are not */
+    bool resolve(QuerySet &set)
+    {
+        if (set.pending.empty()) return true;
+
+        // Commands finish in order, so if the last timestamp is done, all of them are
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(set.queries[set.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (PendingZone &zone : set.pending)
+        {
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(zone.begin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(zone.end, GL_QUERY_RESULT, &end);
+            ProfileSample *sample = findSample(zone.frame, zone.sample);
+            if (sample) sample->gpuMilliseconds = (end - begin) / 1000000.0;
+        }
+        set.pending.clear();
+        return true;
+    }
+
+
+
+    void beginFrame()
+    {
+        if (!OPTIONS::profiler) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentFrame++;
+            history.push_back({ currentFrame, {} });
+            while ((int)history.size() > OPTIONS::profilerHistory) history.pop_front();
+        }
+
+        // The GPU is still busy with this set's last frame, give up on those timings rather than waiting
+        QuerySet &set = querySets[currentFrame % latency];
+        if (!resolve(set))
+        {
+            droppedFrames++;
+            set.pending.clear();
+        }
+        set.used  = 0;
+        set.frame = currentFrame;
+    }
+
+    void endFrame()
+    {
+        if (!OPTIONS::profiler) return;
+        // Pick up any results that have arrived, so they are available as early as possible
+        for (QuerySet &set : querySets)
+            if (set.frame != currentFrame) resolve(set);
+    }
+
+
+
+    Zone::Zone(const std::string &name, bool gpu)
+        : trace(name, "zone")
+    {
+        this->zone = -1;
+        this->gpu  = gpu;
+        if (!OPTIONS::profiler) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (history.empty()) return; // before the first frame
+            zone  = getZone(name);
+            frame = currentFrame;
+            history.back().samples.push_back({ zone });
+            sample = history.back().samples.size() - 1;
+        }
+
+        if (gpu)
+        {
+            QuerySet &set = querySets[frame % latency];
+            GLuint begin  = nextQuery(set);
+            endQuery      = nextQuery(set);
+            glQueryCounter(begin, GL_TIMESTAMP);
+            set.pending.push_back({ frame, sample, begin, endQuery });
+        }
+        start = std::chrono::steady_clock::now();
+    }
+
+    Zone::~Zone()
+    {
+        if (zone == -1) return;
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (gpu) glQueryCounter(endQuery, GL_TIMESTAMP);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ProfileSample *sample = findSample(frame, this->sample);
+        if (sample) sample->cpuMilliseconds = milliseconds;
+    }
+
+
+
+    std::vector<ProfileFrame> getHistory()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::vector<ProfileFrame>(history.begin(), history.end());
+    }
+
+    std::vector<ZoneStatistics> getStatistics()
+    {
+        std::vector<ProfileFrame> frames = getHistory();
+        std::vector<ZoneStatistics> statistics;
+        std::vector<unsigned long> gpuFrames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const std::string &name : zoneNames)
+            {
+                ZoneStatistics zone;
+                zone.name = name;
+                statistics.push_back(zone);
+            }
+        }
+        gpuFrames.resize(statistics.size(), 0);
+
+        for (ProfileFrame &frame : frames)
+        {
+            // Sum up zones that ran several times this frame (like the probe faces)
+            std::map<int, std::pair<double, double>> totals;
+            std::map<int, bool> gpuKnown;
+            for (ProfileSample &sample : frame.samples)
+            {
+                if (sample.cpuMilliseconds < 0) continue;
+                totals[sample.zone].first += sample.cpuMilliseconds;
+                totals[sample.zone].second += std::max(0.0, sample.gpuMilliseconds);
+                if (!gpuKnown.count(sample.zone)) gpuKnown[sample.zone] = true;
+                if (sample.gpuMilliseconds < 0) gpuKnown[sample.zone] = false;
+            }
+            for (auto &total : totals)
+            {
+                ZoneStatistics &zone = statistics[total.first];
+                zone.frames++;
+                zone.cpuAverage += total.second.first;
+                zone.cpuMax = std::max(zone.cpuMax, total.second.first);
+                if (!gpuKnown[total.first]) continue;
+                gpuFrames[total.first]++;
+                zone.gpuAverage += total.second.second;
+                zone.gpuMax = std::max(zone.gpuMax, total.second.second);
+            }
+        }
+
+        for (size_t i = 0; i < statistics.size(); i++)
+        {
+            if (statistics[i].frames) statistics[i].cpuAverage /= statistics[i].frames;
+            if (gpuFrames[i]) statistics[i].gpuAverage /= gpuFrames[i];
+        }
+        return statistics;
+    }
+
+    std::string getZoneName(int zone)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return zoneNames.at(zone);
+    }
+
+    unsigned long getDroppedFrames()
+    {
+        return droppedFrames;
+    }
+
+
+
+    bool writeCSV(const std::string &filename)
+    {
+        FILE *file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            fprintf(stderr, "Profiler: Could not write %s\n", filename.c_str());
+            return false;
+        }
+
+        std::vector<ProfileFrame> frames = getHistory();
+        fprintf(file, "frame,zone,cpu_ms,gpu_ms\n");
+        for (ProfileFrame &frame : frames)
+        {
+            for (ProfileSample &sample : frame.samples)
+            {
+                if (sample.cpuMilliseconds < 0) continue;
+                fprintf(file, "%lu,\"%s\",%.4f,", frame.frame, getZoneName(sample.zone).c_str(), sample.cpuMilliseconds);
+                if (0 <= sample.gpuMilliseconds) fprintf(file, "%.4f", sample.gpuMilliseconds);
+                fprintf(file, "\n");
+            }
+        }
+        fclose(file);
+        return true;
+    }
+
+    void printStatistics()
+    {
+        std::vector<ZoneStatistics> statistics = getStatistics();
+        printf("Profiler (last %d frames, %lu frames of GPU timings dropped):\n", OPTIONS::profilerHistory, droppedFrames);
+        printf("  %-28s %10s %10s %10s %10s\n", "zone", "cpu avg", "cpu max", "gpu avg", "gpu max");
+        for (ZoneStatistics &zone : statistics)
+        {
+            if (zone.frames == 0) continue;
+            printf("  %-28s %7.3f ms %7.3f ms %7.3f ms %7.3f ms\n",
+                   zone.name.c_str(), zone.cpuAverage, zone.cpuMax, zone.gpuAverage, zone.gpuMax);
+        }
+    }
+}
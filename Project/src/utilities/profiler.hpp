@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "trace.hpp"
+
+
+
+// Time spent in a zone during one frame, in milliseconds. Negative means not measured (yet)
+struct ProfileSample
+{
+    int zone;
+    double cpuMilliseconds = -1;
+    double gpuMilliseconds = -1;
+};
+
+// All samples recorded during a frame (a zone that ran several times has several samples)
+struct ProfileFrame
+{
+    unsigned long frame;
+    std::vector<ProfileSample> samples;
+};
+
+// Summary of one zone over the frames in the history, times are per frame (summed if it ran several times)
+struct ZoneStatistics
+{
+    std::string name;
+    unsigned long frames = 0;
+    double cpuAverage    = 0;
+    double cpuMax        = 0;
+    double gpuAverage    = 0; // only frames where the GPU time is known
+    double gpuMax        = 0;
+};
+
+/**
+ * CPU and GPU frame profiler with named, scoped zones.
+ *
+ * CPU time is measured with the steady clock. GPU time is measured with timestamp queries (glQueryCounter) around the
+ * same commands, which unlike GL_TIME_ELAPSED can be nested. The queries are kept in a ring of one set per frame, and
+ * results are only read once they are available, so the CPU never waits for the GPU. GPU times therefore arrive a few
+ * frames late, and if a frame's queries are still not done when its set is needed again they are dropped.
+ *
+ * The last OPTIONS::profilerHistory frames are kept, and can be read or written to a CSV file.
+ *
+ *      PROFILER::beginFrame();
+ *      {
+ *          PROFILER::Zone zone("main pass");
+ *          ...
+ *      }
+ *      PROFILER::endFrame();
+ */
+namespace PROFILER
+{
+    void beginFrame();
+    void endFrame();
+
+    // Measures from construction to destruction, GPU time is only measured if gpu is true (GL thread only).
+    // Every zone also shows up in the trace (see TRACE)
+    class Zone
+    {
+    public:
+        Zone(const std::string &name, bool gpu = true);
+        ~Zone();
+
+    private:
+        Zone(Zone const &) = delete;
+        Zone &operator=(Zone const &) = delete;
+
+        TRACE::Scope trace;
+        int zone;
+        unsigned long frame;
+        size_t sample;
+        bool gpu;
+        GLuint endQuery = 0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    std::vector<ProfileFrame> getHistory();
+    std::vector<ZoneStatistics> getStatistics();
+    std::string getZoneName(int zone);
+    unsigned long getDroppedFrames();
+
+    // One row per sample: frame, zone, cpu and gpu milliseconds (empty if not known)
+    bool writeCSV(const std::string &filename);
+    void printStatistics();
+}
@@ -0,0 +1,73 @@
+#include "regression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+
+
+namespace REGRESSION
+{
+    ImageDifference compareImages(Image const &expected, Image const &actual, int pixelTolerance)
+    {
+        ImageDifference difference;
+        if (expected.width != actual.width || expected.height != actual.height) return difference;
+        difference.sameSize = true;
+
+        size_t count = expected.pixels.size();
+        if (count == 0) return difference;
+
+        double squaredError     = 0;
+        double totalError       = 0;
+        unsigned long differing = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            const Pixel &a = expected.pixels[i];
+            const Pixel &b = actual.pixels[i];
+            int errors[3]  = { std::abs(a.r - b.r), std::abs(a.g - b.g), std::abs(a.b - b.b) };
+
+            int pixelError = 0;
+            for (int error : errors)
+            {
+                totalError += error;
+                squaredError += error * error;
+                pixelError = std::max(pixelError, error);
+            }
+            difference.maxError = std::max(difference.maxError, pixelError);
+            if (pixelTolerance < pixelError) differing++;
+        }
+
+        difference.meanError       = totalError / (count * 3.0);
+        difference.differingPixels = differing / (double)count;
+        double meanSquaredError    = squaredError / (count * 3.0);
+        if (0 < meanSquaredError) difference.psnr = 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+        return difference;
+    }
+
+
+
+    std::map<std::string, double> readBaseline(const std::string &filename)
+    {
+        std::map<std::string, double> baseline;
+        std::ifstream file(filename);
+        std::string name;
+        double milliseconds;
+        while (file >> name >> milliseconds) baseline[name] = milliseconds;
+        return baseline;
+    }
+
+    bool writeBaseline(const std::string &filename, std::map<std::string, double> const &baseline)
+    {
+        FILE *file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            fprintf(stderr, "Regression: Could not write %s\n", filename.c_str());
+            return false;
+        }
+        for (auto const &entry : baseline) fprintf(file, "%s %.3f\n", entry.first.c_str(), entry.second);
+        fclose(file);
+        return true;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "classes/image.hpp"
+
+
+
+// How much two images differ, errors are per color channel (0 - 255)
+struct ImageDifference
+{
+    bool sameSize          = false;
+    double meanError       = 0;
+    int maxError           = 0;
+    double differingPixels = 0;   // fraction of pixels where a channel differs by more than the tolerance
+    double psnr            = 100; // peak signal to noise ratio in dB, 100 if the images are identical
+};
+
+/**
+ * Helpers for the regression test (--regression), which renders fixed views of the scene headless and compares them to
+ * golden images and a timing baseline stored in OPTIONS::regressionDirectory.
+ */
+namespace REGRESSION
+{
+    /**
+     * @brief Compares the color of two images pixel by pixel (alpha is ignored)
+     *
+     * @param pixelTolerance How much a channel may differ before the pixel counts as different
+     */
+    ImageDifference compareImages(Image const &expected, Image const &actual, int pixelTolerance);
+
+    // The baseline is a text file with one "<view name> <milliseconds>" per line
+    std::map<std::string, double> readBaseline(const std::string &filename);
+    bool writeBaseline(const std::string &filename, std::map<std::string, double> const &baseline);
+}
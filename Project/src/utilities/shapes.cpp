@@ -34,6 +34,7 @@ namespace SHAPES
         mesh.addQuad(TBR, TFR, BFR, BBR); // Right
         mesh.addQuad(BFR, TFR, TFL, BFL); // Front
         mesh.addQuad(BBL, TBL, TBR, BBR); // Back
+        mesh.weld();
         return mesh;
     }
 
@@ -59,6 +60,7 @@ namespace SHAPES
         mesh.addTriangle(TOP, FR, BR); // Right
         mesh.addTriangle(TOP, BR, BL); // Back
         mesh.addTriangle(TOP, BL, FL); // Left
+        mesh.weld();
         return mesh;
     }
 
@@ -87,6 +89,7 @@ namespace SHAPES
         mesh.addQuad(BT, FT, FR, BR); // Right
         mesh.addTriangle(FT, FL, FR); // Front
         mesh.addTriangle(BT, BR, BL); // Back
+        mesh.weld();
         return mesh;
     }
 
@@ -134,6 +137,7 @@ namespace SHAPES
             mesh.addQuad(TL, BL, BR, TR, CURVE); // Edge
         }
 
+        mesh.weld();
         return mesh;
     }
 
@@ -161,6 +165,7 @@ namespace SHAPES
                 mesh.addQuad(TL, BL, BR, TR, SPHERE);
             }
         }
+        mesh.weld();
         return mesh;
     }
 }
\ No newline at end of file
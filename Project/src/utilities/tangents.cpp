@@ -0,0 +1,123 @@
+#include "tangents.hpp"
+
+#include <cmath>
+
+#include "utilities/trace.hpp"
+
+
+
+namespace TANGENTS
+{
+    // Triangles or vertices per parallel chunk
+    const size_t chunkSize = 4096;
+
+    void forRange(ThreadPool *workers, size_t count, std::function<void(size_t, size_t)> function)
+    {
+        if (workers)
+            workers->parallelFor(count, chunkSize, function);
+        else if (count > 0)
+            function(0, count);
+    }
+
+    // Projects the vector onto the plane of the normal, zero if it is (close to) parallel to the normal
+    glm::vec3 orthogonalize(glm::vec3 vector, glm::vec3 normal)
+    {
+        glm::vec3 projected = vector - normal * glm::dot(normal, vector);
+        float length        = glm::length(projected);
+        return 1e-20f < length ? projected / length : glm::vec3(0);
+    }
+
+    // Angle between the edges a and b, leaving the corner
+    float cornerAngle(glm::vec3 a, glm::vec3 b)
+    {
+        float lengths = glm::length(a) * glm::length(b);
+        if (lengths <= 0) return 0;
+        return std::acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f));
+    }
+
+    // Any unit vector orthogonal to the normal, for vertices where the texture coordinates say nothing
+    glm::vec3 anyTangent(glm::vec3 normal)
+    {
+        glm::vec3 axis = std::abs(normal.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        return orthogonalize(axis, normal);
+    }
+
+
+
+    void generate(Mesh &mesh, ThreadPool *workers)
+    {
+        size_t vertexCount = mesh.vertices.size();
+        if (vertexCount == 0 || mesh.normals.size() != vertexCount || mesh.textureCoordinates.size() != vertexCount) return;
+
+        // Tangents from the file are kept, only the vertices without one (w is 0, a real handedness is -1 or 1) are done.
+        // That is all of them if the file has none, or those of the primitives without tangents if some have them
+        mesh.tangents.resize(vertexCount, glm::vec4(0));
+        bool complete = true;
+        for (glm::vec4 const &tangent : mesh.tangents) complete = complete && tangent.w != 0;
+        if (complete) return;
+
+        TRACE::Scope scope("generate tangents", "loading");
+        std::vector<unsigned int> const &indices = mesh.indices;
+        size_t triangleCount                     = indices.size() / 3;
+
+        // Each corner's weighted tangent and bitangent, written by one triangle only so they can be made in parallel
+        std::vector<glm::vec3> cornerTangents(triangleCount * 3), cornerBitangents(triangleCount * 3);
+        forRange(workers, triangleCount, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++)
+            {
+                unsigned int corners[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+                glm::vec3 p0 = mesh.vertices[corners[0]], p1 = mesh.vertices[corners[1]], p2 = mesh.vertices[corners[2]];
+                glm::vec2 uv0 = mesh.textureCoordinates[corners[0]];
+                glm::vec2 uv1 = mesh.textureCoordinates[corners[1]];
+                glm::vec2 uv2 = mesh.textureCoordinates[corners[2]];
+
+                // Solve the edges as combinations of the tangent and bitangent, with the texture coordinate deltas
+                glm::vec3 deltaPos1 = p1 - p0, deltaPos2 = p2 - p0;
+                glm::vec2 deltaUV1 = uv1 - uv0, deltaUV2 = uv2 - uv0;
+                float area         = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+                if (std::abs(area) <= 1e-20f) continue; // no texture area, so no direction either
+
+                // Only the directions matter (MikkTSpace uses the sign of the area for the handedness the same way)
+                float sign          = area < 0 ? -1.0f : 1.0f;
+                glm::vec3 tangent   = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * sign;
+                glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * sign;
+
+                for (int c = 0; c < 3; c++)
+                {
+                    glm::vec3 position = mesh.vertices[corners[c]];
+                    glm::vec3 normal   = mesh.normals[corners[c]];
+                    float weight       = cornerAngle(mesh.vertices[corners[(c + 1) % 3]] - position,
+                                                     mesh.vertices[corners[(c + 2) % 3]] - position);
+                    cornerTangents[t * 3 + c]   = orthogonalize(tangent, normal) * weight;
+                    cornerBitangents[t * 3 + c] = orthogonalize(bitangent, normal) * weight;
+                }
+            }
+        });
+
+        // The corners of every vertex (compressed rows), so each vertex can sum its own in parallel
+        std::vector<unsigned int> firstCorner(vertexCount + 1, 0), corners(triangleCount * 3);
+        for (size_t i = 0; i < triangleCount * 3; i++) firstCorner[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++) firstCorner[v + 1] += firstCorner[v];
+        std::vector<unsigned int> filled(firstCorner.begin(), firstCorner.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) corners[filled[indices[i]]++] = (unsigned int)i;
+
+        forRange(workers, vertexCount, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++)
+            {
+                if (mesh.tangents[v].w != 0) continue;
+                glm::vec3 tangent(0), bitangent(0);
+                for (unsigned int i = firstCorner[v]; i < firstCorner[v + 1]; i++)
+                {
+                    tangent += cornerTangents[corners[i]];
+                    bitangent += cornerBitangents[corners[i]];
+                }
+
+                glm::vec3 normal = mesh.normals[v];
+                tangent          = orthogonalize(tangent, normal);
+                if (tangent == glm::vec3(0)) tangent = anyTangent(normal);
+                float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0 ? -1.0f : 1.0f;
+                mesh.tangents[v] = glm::vec4(tangent, handedness);
+            }
+        });
+    }
+}
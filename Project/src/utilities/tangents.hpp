@@ -0,0 +1,26 @@
+#pragma once
+
+#include "classes/mesh.hpp"
+#include "classes/threadPool.hpp"
+
+/**
+ * Per vertex tangent frames for normal mapping, in the same convention as MikkTSpace (which is what glTF files and most
+ * normal map bakers use): the tangent points along +u of the texture coordinates, orthogonal to the vertex normal, and
+ * w is the handedness, the bitangent (+v) is cross(normal, tangent) * w.
+ *
+ *      1. Every triangle corner gets the triangle's tangent and bitangent projected onto the plane of the corner's
+ *         normal, weighted by the angle of the corner (so how finely a surface is split does not matter)
+ *      2. Every vertex sums the corners that use it, and makes the sum orthonormal to its normal
+ *
+ * Unlike MikkTSpace, vertices are never split, a vertex shared by mirrored parts of the texture gets one handedness.
+ */
+namespace TANGENTS
+{
+    /**
+     * @brief Fills in mesh.tangents where the mesh has none (from the file), unless it has no texture coordinates or
+     * normals. A tangent with w = 0 counts as missing, that is what primitives without tangents are padded with
+     *
+     * @param workers Both passes are split over these when given, otherwise they run on the calling thread
+     */
+    void generate(Mesh &mesh, ThreadPool *workers = nullptr);
+}
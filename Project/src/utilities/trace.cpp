@@ -0,0 +1,167 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "options.hpp"
+
+
+
+namespace TRACE
+{
+    struct Event
+    {
+        char name[64];
+        const char *category; // always a string literal
+        double start;         // microseconds since the trace started
+        double duration;
+    };
+
+    // Only the owning thread writes, others may read at the same time
+    struct ThreadBuffer
+    {
+        int id;
+        char name[64] = "";
+        std::unique_ptr<Event[]> events;
+        std::atomic<unsigned long> written { 0 };
+    };
+
+    const std::chrono::steady_clock::time_point traceStart = std::chrono::steady_clock::now();
+
+    // Only used when a thread records its first event, and when writing
+    std::mutex buffersMutex;
+    std::vector<ThreadBuffer *> buffers;
+
+
+
+    ThreadBuffer *getBuffer()
+    {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (buffer) return buffer;
+
+        buffer         = new ThreadBuffer();
+        buffer->events = std::unique_ptr<Event[]>(new Event[OPTIONS::traceEventsPerThread]);
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffer->id = (int)buffers.size() + 1;
+        buffers.push_back(buffer);
+        return buffer;
+    }
+
+    void copyName(char *destination, const char *source)
+    {
+        strncpy(destination, source, 63);
+        destination[63] = '\0';
+    }
+
+    double microsecondsSinceStart(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration<double, std::micro>(time - traceStart).count();
+    }
+
+
+
+    void setThreadName(const std::string &name)
+    {
+        if (!OPTIONS::tracing) return;
+        copyName(getBuffer()->name, name.c_str());
+    }
+
+    void complete(const char *name, const char *category, std::chrono::steady_clock::time_point start)
+    {
+        if (!OPTIONS::tracing) return;
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        ThreadBuffer *buffer = getBuffer();
+        unsigned long index  = buffer->written.load(std::memory_order_relaxed);
+        Event &event         = buffer->events[index % OPTIONS::traceEventsPerThread];
+        copyName(event.name, name);
+        event.category = category;
+        event.start    = microsecondsSinceStart(start);
+        event.duration = microsecondsSinceStart(end) - event.start;
+        // Publish the event, readers never look past this
+        buffer->written.store(index + 1, std::memory_order_release);
+    }
+
+
+
+    Scope::Scope(const std::string &name, const char *category)
+    {
+        copyName(this->name, name.c_str());
+        this->category = category;
+        this->start    = std::chrono::steady_clock::now();
+    }
+
+    Scope::~Scope()
+    {
+        complete(name, category, start);
+    }
+
+
+
+    // Writes the string with the characters JSON does not allow escaped
+    void writeString(FILE *file, const char *string)
+    {
+        fputc('"', file);
+        for (const char *c = string; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                fprintf(file, "\\%c", *c);
+            else if ((unsigned char)*c < 0x20)
+                fprintf(file, "\\u%04x", *c);
+            else
+                fputc(*c, file);
+        }
+        fputc('"', file);
+    }
+
+    bool write(const std::string &filename)
+    {
+        if (!OPTIONS::tracing) return false;
+        FILE *file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            fprintf(stderr, "Trace: Could not write %s\n", filename.c_str());
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        for (ThreadBuffer *buffer : buffers)
+        {
+            // Thread names are metadata events
+            fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->id);
+            writeString(file, buffer->name[0] ? buffer->name : "thread");
+            fprintf(file, "}}");
+            first = false;
+
+            // Copy the newest events, and throw away any the owner may have overwritten while we were copying
+            const unsigned long capacity = OPTIONS::traceEventsPerThread;
+            unsigned long end            = buffer->written.load(std::memory_order_acquire);
+            unsigned long begin          = capacity < end ? end - capacity : 0;
+            std::vector<Event> events;
+            for (unsigned long i = begin; i < end; i++) events.push_back(buffer->events[i % capacity]);
+            // The slot of event number "overwritten" is the one the owner may be writing right now, so it is skipped as well
+            unsigned long overwritten = buffer->written.load(std::memory_order_acquire);
+            unsigned long valid       = capacity <= overwritten ? overwritten - capacity + 1 : 0;
+
+            for (unsigned long i = begin; i < end; i++)
+            {
+                if (i < valid) continue;
+                Event &event = events[i - begin];
+                fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"cat\":", buffer->id, event.start, event.duration);
+                writeString(file, event.category);
+                fprintf(file, ",\"name\":");
+                writeString(file, event.name);
+                fprintf(file, "}");
+            }
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+}
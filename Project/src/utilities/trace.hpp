@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+
+
+/**
+ * Records what every thread was doing and when, and writes it as Chrome trace-event JSON
+ * (open it in chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Each thread writes to its own ring buffer without taking any locks, the newest OPTIONS::traceEventsPerThread
+ * events are kept. Writing the file only reads the buffers, so it can be done at any time from any thread.
+ *
+ *      void loadSomething()
+ *      {
+ *          TRACE::Scope scope("load something", "loading");
+ *          ...
+ *      }
+ */
+namespace TRACE
+{
+    // Name shown for the calling thread in the trace
+    void setThreadName(const std::string &name);
+
+    // Records an event that started at the given time and ends now
+    void complete(const char *name, const char *category, std::chrono::steady_clock::time_point start);
+
+    // Records the time between construction and destruction
+    class Scope
+    {
+    public:
+        Scope(const std::string &name, const char *category = "scope");
+        ~Scope();
+
+    private:
+        Scope(Scope const &) = delete;
+        Scope &operator=(Scope const &) = delete;
+
+        char name[64];
+        const char *category;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    bool write(const std::string &filename);
+}
@@ -17,6 +17,11 @@ namespace STB
         return stbi_load(filename, width, height, comp, req_comp);
     }
 
+    bool info(const char *filename, int *width, int *height, int *comp)
+    {
+        return stbi_info(filename, width, height, comp) != 0;
+    }
+
     void write(const char *filename, int width, int height, void *data)
     {
         stbi_flip_vertically_on_write(true);
@@ -5,6 +5,7 @@
 namespace STB
 {
     unsigned char *load(const char *filename, int *width, int *height, int *comp, int req_comp);
+    bool info(const char *filename, int *width, int *height, int *comp); // reads only the header
     void write(const char *filename, int width, int height, void *data);
 }
 